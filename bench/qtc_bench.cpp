@@ -0,0 +1,429 @@
+// bench/qtc_bench.cpp
+// Micro/macro benchmarks for the node hot paths.
+//
+// Every benchmark prints one JSON object per line on stdout so results can be
+// collected across commits, e.g.
+//   {"bench":"block_mine/diff3","iters":12,"ns_per_op":...,"ops_per_sec":...,"items_per_sec":...}
+#include "blockchain/Blockchain.h"
+#include "blockchain/Block.h"
+#include "blockchain/ChainVerifier.h"
+#include "blockchain/Transaction.h"
+#include "crypto/Hash.h"
+#include "crypto/Signature.h"
+#include "network/Node.h"
+#include "utils/Logger.h"
+#include "vm/VM.h"
+#include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using pt = boost::property_tree::ptree;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+  std::string filter;
+  double min_time{0.2};
+  bool list{false};
+};
+
+// A benchmark body runs `iters` operations and returns the seconds spent in the
+// measured region, so per-batch setup can be kept out of the numbers.
+// `items` is the number of logical items one operation processes (txs, hashes).
+struct Bench {
+  std::string name;
+  uint64_t items;
+  std::function<double(uint64_t iters)> body;
+};
+
+// keeps results observable so the measured loops are not optimized away
+volatile size_t g_sink = 0;
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+void report(const std::string& name, uint64_t iters, double secs, uint64_t items) {
+  double ns = secs * 1e9 / static_cast<double>(iters);
+  double ops = static_cast<double>(iters) / secs;
+  std::printf("{\"bench\":\"%s\",\"iters\":%llu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f,\"items_per_sec\":%.1f}\n",
+              name.c_str(), static_cast<unsigned long long>(iters), ns, ops, ops * static_cast<double>(items));
+  std::fflush(stdout);
+}
+
+void run(const Bench& b, const Options& o) {
+  uint64_t iters = 1;
+  double secs = b.body(iters);
+  while (secs < o.min_time && iters < (1ULL << 40)) {
+    double scale = secs > 0 ? (o.min_time * 1.2) / secs : 10.0;
+    if (scale > 10.0) scale = 10.0;
+    if (scale < 2.0) scale = 2.0;
+    iters = static_cast<uint64_t>(static_cast<double>(iters) * scale);
+    secs = b.body(iters);
+  }
+  report(b.name, iters, secs, b.items);
+}
+
+// a fixed set of sender keys; tx i of a block is signed by key i % size
+const std::vector<QTC::Signature::KeyPair>& keys() {
+  static const std::vector<QTC::Signature::KeyPair> k = []{
+    std::vector<QTC::Signature::KeyPair> v;
+    for (int i = 0; i < 1024; ++i) v.push_back(QTC::Signature::generate());
+    return v;
+  }();
+  return k;
+}
+
+std::string addr(uint64_t i) {
+  static const std::vector<std::string> a = []{
+    std::vector<std::string> v;
+    for (const auto& k : keys()) v.push_back(QTC::Signature::address(k.pub));
+    return v;
+  }();
+  return a[i % a.size()];
+}
+
+QTC::Transaction signed_tx(uint64_t from, uint64_t to, uint64_t amount) {
+  QTC::Transaction tx(addr(from), addr(to), amount, 0);
+  const auto& k = keys()[from % keys().size()];
+  tx.sign(k.priv, k.pub);
+  return tx;
+}
+
+// Every tx gets a fresh amount so no two signatures in a process repeat.
+// Tx i pays from key i to key i + 512, so txs only conflict in pairs.
+QTC::Block make_block(uint32_t idx, const std::string& prev, size_t ntx, uint32_t diff) {
+  static uint64_t amount = 0;
+  QTC::Block b(idx, prev, diff);
+  b.addTransaction(QTC::Transaction("COINBASE", addr(0), 10000, 0));
+  for (size_t i = 1; i < ntx; ++i) b.addTransaction(signed_tx(i, i + keys().size() / 2, ++amount));
+  return b;
+}
+
+std::string to_json(const pt& t) {
+  std::ostringstream o; boost::property_tree::write_json(o, t, false); return o.str();
+}
+
+std::vector<Bench> all_benches() {
+  std::vector<Bench> v;
+
+  for (size_t len : {32u, 64u, 256u, 4096u}) {
+    std::string msg(len, 'q');
+    v.push_back({"sha256_hex/" + std::to_string(len), 1, [msg](uint64_t n) {
+      size_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) sink += QTC::Hash::sha256Hex(msg).size();
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+  }
+
+  // 128-byte messages are the size of a merkle node input (two hex txids);
+  // each backend the CPU supports is pinned in turn
+  using QTC::Hash;
+  for (Hash::Impl impl : {Hash::Impl::Portable, Hash::Impl::ShaNi, Hash::Impl::Avx2}) {
+    if (!Hash::supported(impl)) continue;
+    const size_t batch = 64;
+    v.push_back({std::string("sha256_batch/") + Hash::name(impl) + "/128", batch, [impl, batch](uint64_t n) {
+      std::vector<std::string> msgs;
+      for (size_t i = 0; i < batch; ++i) msgs.push_back(std::string(128, static_cast<char>('a' + i % 26)));
+      std::vector<Hash::Span> in;
+      for (auto& m : msgs) in.push_back(Hash::Span{m.data(), m.size()});
+      std::vector<Hash::Digest> out(batch);
+      Hash::force(impl);
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) Hash::sha256Batch(in.data(), out.data(), batch);
+      double s = seconds_since(t0);
+      g_sink = out[0][0];
+      Hash::reset();
+      return s;
+    }});
+  }
+
+  v.push_back({"tx_construct", 1, [](uint64_t n) {
+    size_t sink = 0;
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < n; ++i) sink += QTC::Transaction(addr(1), addr(2), i + 1, 0).getId().size();
+    g_sink = sink;
+    return seconds_since(t0);
+  }});
+
+  // difficulty 0 makes mine() compute the merkle root and a single header hash
+  for (size_t ntx : {1u, 16u, 256u, 4096u}) {
+    v.push_back({"merkle/" + std::to_string(ntx), ntx, [ntx](uint64_t n) {
+      auto b = make_block(1, "prev", ntx, 0);
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) b.mine();
+      return seconds_since(t0);
+    }});
+  }
+
+  // hashrate: one op is one header hash, so ops_per_sec is hashes per second
+  for (uint32_t diff : {1u, 2u, 3u}) {
+    v.push_back({"block_mine/diff" + std::to_string(diff), 1, [diff](uint64_t n) {
+      double s = 0;
+      uint64_t hashes = 0;
+      for (uint32_t i = 0; hashes < n; ++i) {
+        auto b = make_block(i, "prev", 4, diff);
+        auto t0 = Clock::now();
+        b.mine();
+        s += seconds_since(t0);
+        hashes += b.getNonce();
+      }
+      return s * static_cast<double>(n) / static_cast<double>(hashes);
+    }});
+  }
+
+  for (size_t ntx : {1u, 256u}) {
+    auto b = make_block(1, "prev", ntx, 0);
+    b.mine();
+    v.push_back({"block_to_json/" + std::to_string(ntx), ntx, [b](uint64_t n) {
+      size_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) sink += to_json(b.toPtree()).size();
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+    std::string js = to_json(b.toPtree());
+    v.push_back({"block_from_json/" + std::to_string(ntx), ntx, [js](uint64_t n) {
+      size_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) {
+        pt t; std::istringstream is(js); boost::property_tree::read_json(is, t);
+        sink += QTC::Block::fromPtree(t)->getTransactions().size();
+      }
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+  }
+
+  v.push_back({"chain_add_transaction", 1, [](uint64_t n) {
+    QTC::Blockchain chain;
+    chain.minePendingTransactions(addr(1));
+    // the same tx every time, so its signature is served from the cache
+    QTC::Transaction tx = signed_tx(1, 2, 1);
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < n; ++i) chain.addTransaction(tx);
+    return seconds_since(t0);
+  }});
+
+  {
+    auto k = QTC::Signature::generate();
+    std::string msg(64, 'f');
+    std::string sig = QTC::Signature::sign(k.priv, msg);
+    v.push_back({"sig_sign", 1, [k, msg](uint64_t n) {
+      size_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) sink += QTC::Signature::sign(k.priv, msg).size();
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+    v.push_back({"sig_verify", 1, [k, msg, sig](uint64_t n) {
+      size_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) sink += QTC::Signature::verify(k.pub, msg, sig);
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+  }
+
+  // block connect through addBlockFromPeer: signature batch, then
+  // updateBalances. "cold" blocks carry signatures never seen before; "warm"
+  // ones had every tx admitted to the mempool first, as on a live node.
+  // exec_tN pins the execution threads (default: one per core).
+  struct ConnectCase { const char* name; size_t ntx; bool warm; size_t threads; };
+  for (const ConnectCase& c : {ConnectCase{"cold", 1000, false, 0}, ConnectCase{"warm", 1000, true, 0},
+                               ConnectCase{"warm/exec_t1", 4096, true, 1}, ConnectCase{"warm/exec_t4", 4096, true, 4}}) {
+    std::string name = "chain_connect_block/" + std::to_string(c.ntx) + "/" + c.name;
+    v.push_back({name, c.ntx, [c](uint64_t n) {
+      QTC::Blockchain chain(0);
+      chain.setExecutionThreads(c.threads);
+      std::vector<QTC::Block> blocks;
+      blocks.reserve(n);
+      std::string prev = chain.getTipHash();
+      // warm blocks all reuse one set of txs that went through the cache
+      static std::map<size_t, QTC::Block> warm_txs;
+      if (c.warm && !warm_txs.count(c.ntx)) {
+        auto t = make_block(0, "", c.ntx, 0);
+        for (const auto& tx : t.getTransactions()) if (tx.getFrom() != "COINBASE") tx.verifySignature();
+        warm_txs.emplace(c.ntx, t);
+      }
+      for (uint64_t i = 0; i < n; ++i) {
+        uint32_t idx = static_cast<uint32_t>(i + 1);
+        if (c.warm) {
+          blocks.emplace_back(idx, prev, 0);
+          for (const auto& tx : warm_txs.at(c.ntx).getTransactions()) blocks.back().addTransaction(tx);
+        } else {
+          blocks.push_back(make_block(idx, prev, c.ntx, 0));
+        }
+        blocks.back().mine();
+        prev = blocks.back().getHash();
+      }
+      auto t0 = Clock::now();
+      for (auto& b : blocks) chain.addBlockFromPeer(b);
+      return seconds_since(t0);
+    }});
+  }
+
+  // whole-chain re-verification; items are blocks. "assumed" puts the
+  // checkpoint at the tip, leaving txids, merkle roots and links.
+  {
+    const size_t kBlocks = 64, kTxs = 64;
+    auto chain = [kBlocks, kTxs]() -> QTC::Blockchain& {
+      static QTC::Blockchain c(0);
+      if (c.getBlockCount() == 1)
+        for (size_t i = 0; i < kBlocks; ++i) {
+          auto b = make_block(static_cast<uint32_t>(i + 1), c.getTipHash(), kTxs, 0);
+          b.mine();
+          c.addBlockFromPeer(b);
+        }
+      return c;
+    };
+    for (bool assumed : {false, true}) {
+      std::string name = "chain_verify/" + std::to_string(kTxs) + (assumed ? "/assumed" : "/full");
+      v.push_back({name, kBlocks + 1, [chain, assumed](uint64_t n) {
+        QTC::Blockchain& c = chain();
+        QTC::ChainVerifier::Options o;
+        if (assumed) o.assumeValid = c.getTipHash();
+        size_t sink = 0;
+        auto t0 = Clock::now();
+        for (uint64_t i = 0; i < n; ++i) sink += QTC::ChainVerifier::run(c, o).checked;
+        g_sink = sink;
+        return seconds_since(t0);
+      }});
+    }
+  }
+
+  // VM: items are executed instructions, so items_per_sec is ops per second
+  {
+    using QTC::Instr;
+    auto op = [](QTC::Op o) { return static_cast<uint8_t>(o); };
+    // r1 = sum(r0 .. 1); three instructions per iteration
+    std::vector<Instr> loop = {
+      {op(QTC::Op::LoadI), 1, 0, 0, 0},
+      {op(QTC::Op::Add), 1, 1, 0, 0},
+      {op(QTC::Op::AddI), 0, 0, 0, -1},
+      {op(QTC::Op::Jnz), 0, 0, 0, 1},
+      {op(QTC::Op::Ret), 1, 0, 0, 0},
+    };
+    std::shared_ptr<QTC::Program> prog(QTC::Program::verify(loop));
+    const uint64_t kIters = 1000000;
+    v.push_back({"vm_loop/" + std::to_string(kIters), 3 * kIters + 2, [prog, kIters](uint64_t n) {
+      struct NoStorage : QTC::Storage {
+        uint64_t load(uint64_t) override { return 0; }
+        void store(uint64_t, uint64_t) override {}
+      } st;
+      uint64_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) sink += QTC::VM::run(*prog, st, UINT64_MAX, &kIters, 1).value;
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+
+    // storage[0] += r0, r1 times, through Blockchain::callContract
+    std::vector<Instr> counter = {
+      {op(QTC::Op::LoadI), 2, 0, 0, 0},
+      {op(QTC::Op::SLoad), 3, 2, 0, 0},
+      {op(QTC::Op::Add), 3, 3, 0, 0},
+      {op(QTC::Op::SStore), 2, 3, 0, 0},
+      {op(QTC::Op::AddI), 1, 1, 0, -1},
+      {op(QTC::Op::Jnz), 1, 0, 0, 1},
+      {op(QTC::Op::Halt), 0, 0, 0, 0},
+    };
+    const uint64_t kRounds = 100;
+    v.push_back({"vm_call_storage/" + std::to_string(kRounds), 5 * kRounds + 2, [counter, kRounds](uint64_t n) {
+      QTC::Blockchain chain;
+      std::string addr = chain.deployContract(counter);
+      std::vector<uint64_t> args = {1, kRounds};
+      QTC::VM::Result res{};
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) chain.callContract(addr, args, 1000000, res);
+      g_sink = res.value;
+      return seconds_since(t0);
+    }});
+  }
+
+  // cost of a debug record on a hot path: filtered out at runtime, and
+  // enabled with the drain thread writing to /dev/null. The enabled case
+  // flushes (untimed) every half ring, so every record is accepted rather
+  // than taking the cheaper ring-full drop path.
+  for (bool on : {false, true}) {
+    v.push_back({std::string("log_debug/") + (on ? "enabled" : "disabled"), 1, [on](uint64_t n) {
+      auto& log = QTC::Logger::instance();
+      log.open("/dev/null");
+      log.setLevel(QTC::LogTag::P2P, on ? QTC::LogLevel::Debug : QTC::LogLevel::Info);
+      std::string remote = "127.0.0.1:18444";
+      const uint64_t batch = on ? QTC::Logger::kCapacity / 2 : n;
+      double secs = 0;
+      for (uint64_t done = 0; done < n; done += batch) {
+        uint64_t k = std::min(batch, n - done);
+        auto t0 = Clock::now();
+        for (uint64_t i = 0; i < k; ++i)
+          QTC_DEBUG(P2P, "%s from %s (%zu bytes)", "block", remote.c_str(), static_cast<size_t>(i));
+        secs += seconds_since(t0);
+        if (on) log.flush();
+      }
+      log.setLevel(QTC::LogTag::P2P, QTC::LogLevel::Info);
+      g_sink = static_cast<size_t>(log.dropped());
+      return secs;
+    }});
+  }
+
+  {
+    auto b = make_block(1, "prev", 16, 0);
+    b.mine();
+    std::string payload = to_json(b.toPtree());
+    v.push_back({"p2p_pack", 1, [payload](uint64_t n) {
+      size_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) sink += QTC::P2P::pack(QTC::P2P::Msg::Block, payload).size();
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+    std::string line = QTC::P2P::pack(QTC::P2P::Msg::Block, payload);
+    line.pop_back();
+    v.push_back({"p2p_unpack", 1, [line](uint64_t n) {
+      size_t sink = 0;
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < n; ++i) {
+        QTC::P2P::Msg t; std::string p;
+        if (QTC::P2P::unpack(line, t, p)) sink += p.size();
+      }
+      g_sink = sink;
+      return seconds_since(t0);
+    }});
+  }
+
+  return v;
+}
+
+void usage() {
+  std::printf("usage: qtc_bench [--list] [--filter=SUBSTR] [--min-time=SECONDS]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    if (a == "--list") o.list = true;
+    else if (a.rfind("--filter=", 0) == 0) o.filter = a.substr(9);
+    else if (a.rfind("--min-time=", 0) == 0) o.min_time = std::stod(a.substr(11));
+    else { usage(); return a == "--help" ? 0 : 1; }
+  }
+
+  for (const auto& b : all_benches()) {
+    if (!o.filter.empty() && b.name.find(o.filter) == std::string::npos) continue;
+    if (o.list) { std::printf("%s\n", b.name.c_str()); continue; }
+    run(b, o);
+  }
+  return 0;
+}
@@ -0,0 +1,361 @@
+// bench/qtc_sim.cpp
+// In-process multi-node network simulation.
+//
+// Runs N Blockchain+P2P pairs in one process, wired over loopback TCP in a
+// chosen topology with an optional per-link delay, produces blocks round-robin
+// while injecting transactions, then brings up a fresh node and times its
+// sync (from a state snapshot when at least two of its --sync-peers offer the
+// same one). The summary is a single JSON object on stdout.
+// With --silent-peer the fresh node first meets a peer that advertises a
+// snapshot and never answers, so the sync has to get past it.
+#include "blockchain/Blockchain.h"
+#include "blockchain/Block.h"
+#include "blockchain/ChainVerifier.h"
+#include "blockchain/Transaction.h"
+#include "crypto/Signature.h"
+#include "network/Node.h"
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+  int nodes{8};
+  std::string topology{"ring"};
+  int degree{3};
+  int latency_ms{0};
+  int blocks{20};
+  int block_interval_ms{500};
+  double tx_rate{100.0};
+  uint32_t difficulty{2};
+  unsigned seed{1};
+  uint64_t snapshot_interval{0}; // 0 keeps the chain default
+  int sync_peers{1};
+  uint64_t prune{0};
+  bool silent_peer{false};
+  int sync_timeout_ms{0}; // 0 keeps the node default
+};
+
+struct SimNode {
+  std::unique_ptr<QTC::Blockchain> chain;
+  std::unique_ptr<QTC::P2P> p2p;
+  QTC::Signature::KeyPair key;
+  std::string addr;
+};
+
+// first time each node saw a block hash / tx id
+struct Recorder {
+  std::mutex mu;
+  std::map<std::string, std::map<int, Clock::time_point>> blocks;
+  std::map<std::string, std::map<int, Clock::time_point>> txs;
+  std::map<std::string, int> block_origin;
+  std::map<std::string, int> tx_origin;
+
+  void block(int node, const std::string& h) {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lk(mu);
+    blocks[h].emplace(node, now);
+  }
+  void tx(int node, const std::string& id) {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lk(mu);
+    txs[id].emplace(node, now);
+  }
+};
+
+std::vector<std::pair<int, int>> make_edges(const Options& o, std::mt19937& rng) {
+  std::set<std::pair<int, int>> e;
+  auto add = [&e](int a, int b) { if (a != b) e.insert({std::min(a, b), std::max(a, b)}); };
+  int n = o.nodes;
+  if (o.topology == "line") {
+    for (int i = 0; i + 1 < n; ++i) add(i, i + 1);
+  } else if (o.topology == "star") {
+    for (int i = 1; i < n; ++i) add(0, i);
+  } else if (o.topology == "mesh") {
+    for (int i = 0; i < n; ++i) for (int j = i + 1; j < n; ++j) add(i, j);
+  } else {
+    // ring, and "random" = ring backbone (keeps the graph connected) plus
+    // degree-2 random chords per node
+    for (int i = 0; i < n; ++i) add(i, (i + 1) % n);
+    if (o.topology == "random") {
+      std::uniform_int_distribution<int> pick(0, n - 1);
+      for (int i = 0; i < n; ++i) for (int k = 2; k < o.degree; ++k) add(i, pick(rng));
+    }
+  }
+  return std::vector<std::pair<int, int>>(e.begin(), e.end());
+}
+
+struct Pct { double p50{0}, p90{0}, p99{0}, max{0}; size_t n{0}; };
+
+Pct percentiles(std::vector<double> v) {
+  Pct p;
+  p.n = v.size();
+  if (v.empty()) return p;
+  std::sort(v.begin(), v.end());
+  auto at = [&v](double q) { return v[std::min(v.size() - 1, static_cast<size_t>(q * static_cast<double>(v.size())))]; };
+  p.p50 = at(0.50); p.p90 = at(0.90); p.p99 = at(0.99); p.max = v.back();
+  return p;
+}
+
+double ms(Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); }
+
+// per-node delay after the origin, and per-item time to reach every node
+void delays(const std::map<std::string, std::map<int, Clock::time_point>>& seen,
+            const std::map<std::string, int>& origin, int nodes,
+            std::vector<double>& hop, std::vector<double>& full, size_t& incomplete) {
+  for (const auto& kv : seen) {
+    auto o = origin.find(kv.first);
+    if (o == origin.end()) continue;
+    auto t0 = kv.second.find(o->second);
+    if (t0 == kv.second.end()) continue;
+    double worst = 0;
+    for (const auto& nt : kv.second) {
+      if (nt.first == o->second) continue;
+      double d = ms(nt.second - t0->second);
+      hop.push_back(d);
+      worst = std::max(worst, d);
+    }
+    if (static_cast<int>(kv.second.size()) == nodes) full.push_back(worst);
+    else ++incomplete;
+  }
+}
+
+void print_pct(const char* name, const Pct& p, bool comma = true) {
+  std::printf("\"%s\":{\"n\":%zu,\"p50_ms\":%.2f,\"p90_ms\":%.2f,\"p99_ms\":%.2f,\"max_ms\":%.2f}%s",
+              name, p.n, p.p50, p.p90, p.p99, p.max, comma ? "," : "");
+}
+
+SimNode make_node(int i, const Options& o, Recorder& rec) {
+  SimNode n;
+  n.chain.reset(new QTC::Blockchain(o.difficulty));
+  n.p2p.reset(new QTC::P2P(n.chain.get()));
+  n.chain->setP2P(n.p2p.get());
+  if (o.snapshot_interval) n.chain->setSnapshotInterval(o.snapshot_interval);
+  n.chain->setPruneDepth(o.prune);
+  n.key = QTC::Signature::generate();
+  n.addr = QTC::Signature::address(n.key.pub);
+  n.chain->addBlockListener([&rec, i](const QTC::Block& b) { rec.block(i, b.getHash()); });
+  n.chain->addTxListener([&rec, i](const QTC::Transaction& t) { rec.tx(i, t.getId()); });
+  n.p2p->setLinkLatency(std::chrono::milliseconds(o.latency_ms));
+  n.p2p->listen(0);
+  return n;
+}
+
+// Accepts peers, claims a snapshot in its hello and then never says anything
+// else; the connections are held open so the other side sees no disconnect.
+class SilentPeer {
+public:
+  explicit SilentPeer(uint64_t height)
+      : acc_(ioc_, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0)) {
+    std::string j = "{\"height\":\"" + std::to_string(height) + "\",\"snapshot\":\"" + std::to_string(height - 1) +
+                    "\",\"pruned\":\"0\",\"low\":\"0\"}";
+    hello_ = std::make_shared<std::string>(QTC::P2P::pack(QTC::P2P::Msg::Hello, j));
+    accept();
+    thread_ = std::thread([this] { ioc_.run(); });
+  }
+  ~SilentPeer() {
+    ioc_.stop();
+    thread_.join();
+  }
+  unsigned short port() const { return acc_.local_endpoint().port(); }
+
+private:
+  void accept() {
+    auto sock = std::make_shared<boost::asio::ip::tcp::socket>(ioc_);
+    acc_.async_accept(*sock, [this, sock](const boost::system::error_code& ec) {
+      if (ec) return;
+      conns_.push_back(sock);
+      boost::asio::async_write(*sock, boost::asio::buffer(*hello_),
+                               [h = hello_](const boost::system::error_code&, size_t) {});
+      accept();
+    });
+  }
+
+  boost::asio::io_context ioc_;
+  boost::asio::ip::tcp::acceptor acc_;
+  std::shared_ptr<std::string> hello_;
+  std::vector<std::shared_ptr<boost::asio::ip::tcp::socket>> conns_;
+  std::thread thread_;
+};
+
+bool wait_height(const std::vector<SimNode>& nodes, uint64_t h, Clock::time_point deadline) {
+  for (;;) {
+    bool all = true;
+    for (const auto& n : nodes) if (n.chain->getBlockCount() < h) { all = false; break; }
+    if (all) return true;
+    if (Clock::now() >= deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void usage() {
+  std::printf("usage: qtc_sim [--nodes=N] [--topology=line|ring|star|mesh|random] [--degree=K]\n"
+              "               [--latency-ms=MS] [--blocks=B] [--block-interval-ms=MS]\n"
+              "               [--tx-rate=TPS] [--difficulty=D] [--seed=S]\n"
+              "               [--snapshot-interval=B] [--sync-peers=K] [--prune=B]\n"
+              "               [--silent-peer] [--sync-timeout-ms=MS]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    auto val = [&a]() { return a.substr(a.find('=') + 1); };
+    if (a.rfind("--nodes=", 0) == 0) o.nodes = std::stoi(val());
+    else if (a.rfind("--topology=", 0) == 0) o.topology = val();
+    else if (a.rfind("--degree=", 0) == 0) o.degree = std::stoi(val());
+    else if (a.rfind("--latency-ms=", 0) == 0) o.latency_ms = std::stoi(val());
+    else if (a.rfind("--blocks=", 0) == 0) o.blocks = std::stoi(val());
+    else if (a.rfind("--block-interval-ms=", 0) == 0) o.block_interval_ms = std::stoi(val());
+    else if (a.rfind("--tx-rate=", 0) == 0) o.tx_rate = std::stod(val());
+    else if (a.rfind("--difficulty=", 0) == 0) o.difficulty = static_cast<uint32_t>(std::stoul(val()));
+    else if (a.rfind("--seed=", 0) == 0) o.seed = static_cast<unsigned>(std::stoul(val()));
+    else if (a.rfind("--snapshot-interval=", 0) == 0) o.snapshot_interval = std::stoull(val());
+    else if (a.rfind("--sync-peers=", 0) == 0) o.sync_peers = std::stoi(val());
+    else if (a.rfind("--prune=", 0) == 0) o.prune = std::stoull(val());
+    else if (a == "--silent-peer") o.silent_peer = true;
+    else if (a.rfind("--sync-timeout-ms=", 0) == 0) o.sync_timeout_ms = std::stoi(val());
+    else { usage(); return a == "--help" ? 0 : 1; }
+  }
+  if (o.nodes < 2) o.nodes = 2;
+  o.sync_peers = std::max(1, std::min(o.sync_peers, o.nodes));
+
+  std::mt19937 rng(o.seed);
+  Recorder rec;
+  std::vector<SimNode> nodes;
+  for (int i = 0; i < o.nodes; ++i) nodes.push_back(make_node(i, o, rec));
+
+  auto edges = make_edges(o, rng);
+  for (const auto& e : edges) nodes[e.first].p2p->connect("127.0.0.1", nodes[e.second].p2p->port());
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  // tx injection: sender/receiver/amount cycle so ids stay unique even though
+  // Transaction timestamps have one-second resolution
+  std::atomic<bool> inject{false}, done{false};
+  std::atomic<uint64_t> submitted{0}, skipped{0};
+  std::thread injector([&]() {
+    if (o.tx_rate <= 0) return;
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / o.tx_rate));
+    auto next = Clock::now();
+    uint64_t c = 0;
+    const uint64_t n = static_cast<uint64_t>(o.nodes);
+    while (!done.load()) {
+      next += period;
+      std::this_thread::sleep_until(next);
+      if (!inject.load()) { next = Clock::now(); continue; }
+      int from = static_cast<int>(c % n);
+      int to = static_cast<int>((c / n) % n);
+      uint64_t amount = 1 + (c / (n * n)) % 100;
+      ++c;
+      auto& src = nodes[from];
+      if (src.chain->getBalance(src.addr) < amount) { skipped++; continue; }
+      QTC::Transaction tx(src.addr, nodes[to].addr, amount, 0);
+      tx.sign(src.key.priv, src.key.pub);
+      {
+        std::lock_guard<std::mutex> lk(rec.mu);
+        rec.tx_origin[tx.getId()] = from;
+      }
+      if (src.chain->addTransaction(tx)) submitted++;
+    }
+  });
+
+  // block production: round-robin miners; each block gets the interval to
+  // propagate before the next one is mined so the network does not fork
+  size_t stalls = 0;
+  auto interval = std::chrono::milliseconds(o.block_interval_ms);
+  for (int k = 0; k < o.blocks; ++k) {
+    if (k == o.nodes) inject = true; // every node has mined once, so all are funded
+    int miner = k % o.nodes;
+    auto t0 = Clock::now();
+    auto before = nodes[miner].chain->getBlockCount();
+    nodes[miner].chain->minePendingTransactions(nodes[miner].addr);
+    if (nodes[miner].chain->getBlockCount() == before) { ++stalls; continue; }
+    {
+      std::lock_guard<std::mutex> lk(rec.mu);
+      rec.block_origin[nodes[miner].chain->getTipHash()] = miner;
+    }
+    if (!wait_height(nodes, before + 1, t0 + interval * 4)) ++stalls;
+    std::this_thread::sleep_until(t0 + interval);
+  }
+  inject = false;
+  done = true;
+  injector.join();
+  uint64_t height = nodes[0].chain->getBlockCount();
+  wait_height(nodes, height, Clock::now() + std::chrono::seconds(10));
+  std::this_thread::sleep_for(interval);
+
+  // late joiner
+  Recorder sync_rec;
+  SimNode fresh = make_node(o.nodes, o, sync_rec);
+  if (o.sync_timeout_ms) fresh.p2p->setSyncTimeout(std::chrono::milliseconds(o.sync_timeout_ms));
+  std::unique_ptr<SilentPeer> silent;
+  auto s0 = Clock::now();
+  if (o.silent_peer) {
+    // its hello goes first, so the fresh node commits to fetching a snapshot
+    silent.reset(new SilentPeer(height));
+    fresh.p2p->connect("127.0.0.1", silent->port());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  // each sync peer through its own loopback address (127.0.0.2, .3, ...),
+  // since the snapshot quorum counts addresses, not connections
+  for (int i = 0; i < o.sync_peers; ++i)
+    fresh.p2p->connect("127.0.0." + std::to_string(2 + i), nodes[i].p2p->port());
+  std::vector<SimNode> just_fresh;
+  just_fresh.push_back(std::move(fresh));
+  bool synced = wait_height(just_fresh, height, s0 + std::chrono::seconds(60));
+  double sync_ms = ms(Clock::now() - s0);
+  bool chain_valid = nodes[0].chain->isChainValid();
+  auto verify = QTC::ChainVerifier::run(*nodes[0].chain, QTC::ChainVerifier::Options{});
+  bool state_match = true;
+  for (const auto& n : nodes)
+    state_match = state_match && just_fresh[0].chain->getBalance(n.addr) == nodes[0].chain->getBalance(n.addr);
+
+  std::vector<double> bhop, bfull, thop, tfull;
+  size_t bincomplete = 0, tincomplete = 0;
+  {
+    std::lock_guard<std::mutex> lk(rec.mu);
+    delays(rec.blocks, rec.block_origin, o.nodes, bhop, bfull, bincomplete);
+    delays(rec.txs, rec.tx_origin, o.nodes, thop, tfull, tincomplete);
+  }
+
+  std::printf("{\"nodes\":%d,\"topology\":\"%s\",\"edges\":%zu,\"latency_ms\":%d,\"difficulty\":%u,"
+              "\"blocks\":%llu,\"base_height\":%llu,\"chain_valid\":%s,\"stalls\":%zu,\"tx_submitted\":%llu,\"tx_skipped\":%llu,",
+              o.nodes, o.topology.c_str(), edges.size(), o.latency_ms, o.difficulty,
+              static_cast<unsigned long long>(height - 1),
+              static_cast<unsigned long long>(nodes[0].chain->getBaseHeight()), chain_valid ? "true" : "false", stalls,
+              static_cast<unsigned long long>(submitted.load()), static_cast<unsigned long long>(skipped.load()));
+  print_pct("block_propagation", percentiles(bhop));
+  print_pct("block_full_propagation", percentiles(bfull));
+  print_pct("tx_propagation", percentiles(thop));
+  print_pct("tx_full_propagation", percentiles(tfull));
+  std::printf("\"verify\":{\"ok\":%s,\"blocks\":%llu,\"headers_only\":%llu,\"blocks_per_sec\":%.0f},",
+              verify.ok ? "true" : "false", static_cast<unsigned long long>(verify.checked),
+              static_cast<unsigned long long>(verify.headersOnly), verify.blocksPerSec);
+  std::printf("\"blocks_incomplete\":%zu,\"tx_incomplete\":%zu,\"sync\":{\"synced\":%s,\"height\":%llu,"
+              "\"snapshot_height\":%llu,\"peers\":%d,\"state_match\":%s,\"ms\":%.2f}}\n",
+              bincomplete, tincomplete, synced ? "true" : "false",
+              static_cast<unsigned long long>(just_fresh[0].chain->getBlockCount()),
+              static_cast<unsigned long long>(just_fresh[0].chain->getBaseHeight()), o.sync_peers,
+              state_match ? "true" : "false", sync_ms);
+
+  for (auto& n : just_fresh) n.p2p->stop();
+  silent.reset();
+  for (auto& n : nodes) n.p2p->stop();
+  return synced && state_match && stalls == 0 ? 0 : 2;
+}
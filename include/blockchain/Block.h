@@ -4,13 +4,33 @@
 #include <cstdint>
 #include <memory>
 #include <boost/property_tree/ptree.hpp>
+#include "crypto/Hash.h"
 
 namespace QTC {
 class Transaction;
 
+// What a pruned node keeps of a block once its body is dropped: enough to
+// link the chain and recheck proof of work. The genesis prev ("0") and an
+// empty merkle root are stored as zero digests.
+struct BlockHeader {
+  uint32_t index{0};
+  uint32_t diff{0};
+  uint32_t nonce{0};
+  uint64_t ts{0};
+  Hash::Digest prev{};
+  Hash::Digest merkle{};
+  Hash::Digest hash{};
+
+  std::string prevHex() const;
+  std::string merkleHex() const;
+  // recomputes the header hash and checks it against hash and diff
+  bool hasValidHash() const;
+};
+
 class Block {
 public:
   Block(uint32_t idx, const std::string& prev, uint32_t diff);
+  Block(uint32_t idx, const std::string& prev, uint32_t diff, uint64_t ts);
 
   void addTransaction(const Transaction& tx);
   void mine();
@@ -20,12 +40,22 @@ public:
   uint32_t getIndex() const;
   uint32_t getDifficulty() const;
   uint64_t getTimestamp() const;
+  uint32_t getNonce() const;
+  const std::string& getMerkle() const;
   const std::vector<Transaction>& getTransactions() const;
 
   boost::property_tree::ptree toPtree() const;
   static std::unique_ptr<Block> fromPtree(const boost::property_tree::ptree& b);
   void setHashForImport(const std::string& h);
 
+  BlockHeader header() const;
+
+  // recomputes merkle root and header hash from the contents and checks
+  // them against the stored ones and the difficulty target
+  bool hasValidHash() const;
+  // the merkle root alone, recomputed from the txids
+  bool hasValidMerkle() const;
+
 private:
   uint32_t index_{0};
   uint64_t ts_{0};
@@ -36,6 +66,7 @@ private:
   uint32_t diff_{0};
   std::string merkle_;
 
+  static std::string merkleRoot(const std::vector<Transaction>& txs);
   void calcMerkle();
   std::string calcHash() const;
 };
@@ -2,50 +2,147 @@
 #include <cstdint>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <atomic>
+#include <deque>
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
 #include "blockchain/Transaction.h"
 #include "blockchain/Block.h"
+#include "config/Constants.h"
+#include "vm/VM.h"
 
 namespace QTC {
 class P2P;
+class ThreadPool;
+struct Snapshot;
 
 class Blockchain {
 public:
-  Blockchain();
+  using BlockListener = std::function<void(const Block&)>;
+  using TxListener = std::function<void(const Transaction&)>;
+
+  explicit Blockchain(uint32_t difficulty = DEFAULT_DIFFICULTY);
+  ~Blockchain();
 
   uint64_t getBlockCount() const;
+  // proof-of-work target every block of this chain is mined at
+  uint32_t getDifficulty() const { return difficulty_; }
   bool isChainValid();
   uint64_t getBalance(const std::string& address) const;
+  // balances of addresses, read in one step; returns the block count they
+  // are current at
+  uint64_t getBalances(const std::vector<std::string>& addresses, std::vector<uint64_t>& out) const;
 
-  void addTransaction(const Transaction& tx);
+  // true if the transaction was accepted into the mempool
+  bool addTransaction(const Transaction& tx);
   void minePendingTransactions(const std::string& minerAddress);
 
-  const Transaction* getPendingById(const std::string& id) const;
+  // copies: the mempool and chain change under other threads
+  std::optional<Transaction> getPendingById(const std::string& id) const;
+  // amount + fee of the mempool transactions sent from each address, read
+  // in one step
+  void getPendingSpends(const std::vector<std::string>& addresses, std::vector<uint64_t>& out) const;
 
   std::unique_ptr<Block> getBlockCopyByIndex(uint64_t i);
   bool addBlockFromPeer(const Block& b);
 
+  // Threads that apply a block's transactions, counting the connecting
+  // thread (0 = one per core, 1 = always serial).
+  void setExecutionThreads(size_t n);
+
+  // Every `blocks` blocks (0 = never) the account state is captured as a
+  // chunked snapshot that peers can fast-sync from.
+  void setSnapshotInterval(uint64_t blocks);
+  std::shared_ptr<const Snapshot> latestSnapshot() const;
+  // Replaces genesis-only state with a downloaded snapshot: the chain then
+  // starts at the snapshot tip and only later blocks are fetched. The tip
+  // must be mined at this chain's difficulty.
+  bool installSnapshot(const Snapshot& s, std::map<std::string, uint64_t> balances);
+  // height of the oldest block whose body is held (0 unless pruned or
+  // installed from a snapshot)
+  uint64_t getBaseHeight() const;
+
+  // Pruned mode: keep bodies only for the last `blocks` blocks (0 = all)
+  // and a header for each older one. Bodies after the latest snapshot are
+  // kept too, so a node syncing from that snapshot can fetch them here.
+  void setPruneDepth(uint64_t blocks);
+  bool isPruned() const;
+
+  // Reads for ChainVerifier. copyRange copies up to `max` blocks starting at
+  // height `from`, or at the oldest one held if that is later: headers for
+  // pruned heights, then full blocks. Returns the height of the first copy.
+  uint64_t copyRange(uint64_t from, size_t max, std::vector<BlockHeader>& headers,
+                     std::vector<std::unique_ptr<Block>>& bodies) const;
+  // height of the held block (or header) with this hash
+  bool findHeight(const std::string& hash, uint64_t& height) const;
+
   void setP2P(P2P* p);
   P2P* p2p() const;
 
-  Block* getLatestBlock();
+  // Called after a block is connected (mined locally or from a peer) or a
+  // transaction enters the mempool, on the thread that made the change and
+  // outside the chain lock.
+  void addBlockListener(BlockListener l);
+  void addTxListener(TxListener l);
+
+  std::unique_ptr<Block> getLatestBlock() const;
+  std::string getTipHash() const;
+
+  // Contracts: verified bytecode addressed by the hash of its encoding, with
+  // a word-addressed storage per contract. Calls run one at a time, so
+  // gasLimit is clamped to MAX_CALL_GAS; a call that runs out of gas leaves
+  // storage untouched.
+  std::string deployContract(const std::vector<Instr>& code, std::string* err = nullptr);
+  bool callContract(const std::string& address, const std::vector<uint64_t>& args, uint64_t gasLimit,
+                    VM::Result& out);
+  uint64_t getStorage(const std::string& address, uint64_t key) const;
 
 private:
-  std::vector<std::unique_ptr<Block>> chain_;
+  // chain_[0] is block base_: genesis normally, the snapshot tip after a
+  // snapshot sync, the oldest unpruned block in pruned mode
+  std::deque<std::unique_ptr<Block>> chain_;
+  uint64_t base_{0};
+  // headers_[i] is block hdr_base_ + i; they run up to base_
+  std::vector<BlockHeader> headers_;
+  uint64_t hdr_base_{0};
+  uint64_t prune_keep_{0};
   std::vector<Transaction> pending_;
-  uint32_t difficulty_{4};
+  uint32_t difficulty_{DEFAULT_DIFFICULTY};
   std::map<std::string, uint64_t> balances_;
-  std::mutex mu_;
+  mutable std::mutex mu_;
   std::atomic<bool> mining_{false};
   uint64_t minted_{0};
   P2P* p2p_{nullptr};
+  std::unique_ptr<ThreadPool> exec_pool_;
+  uint64_t snapshot_interval_{SNAPSHOT_INTERVAL};
+  mutable std::mutex snap_mu_;
+  std::shared_ptr<const Snapshot> snapshot_;
+
+  mutable std::mutex vm_mu_;
+  std::map<std::string, std::shared_ptr<const Program>> contracts_;
+  std::map<std::string, std::map<uint64_t, uint64_t>> storage_;
+
+  std::mutex listen_mu_;
+  std::vector<BlockListener> block_listeners_;
+  std::vector<TxListener> tx_listeners_;
+
+  struct SnapshotSource;
 
+  uint64_t height() const { return base_ + chain_.size(); }
+  std::unique_ptr<SnapshotSource> snapshotDue() const;
+  void publishSnapshot(std::unique_ptr<SnapshotSource> src);
+  void prune();
   void createGenesisBlock();
   void updateBalances(Block* block);
+  void applySerial(const std::vector<Transaction>& txs);
   bool validAddress(const std::string& a) const;
+  bool validSignatures(const Block& b) const;
+  bool validProofs(const Block& b) const;
+  void notifyBlock(const Block& b);
+  void notifyTx(const Transaction& tx);
 };
 
 } // namespace QTC
@@ -0,0 +1,53 @@
+// include/blockchain/ChainVerifier.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace QTC {
+class Blockchain;
+
+// Re-checks the consensus rules of stored blocks over a height range:
+// index and prev link, txids, merkle root, difficulty (the chain's), header
+// hash and proof of work, signatures and zk proofs. The range is read in
+// windows; within a window blocks are checked in parallel. Blocks at or
+// below the assumed-valid checkpoint skip the signature, proof and PoW
+// checks. Pruned heights have only a header, so they get the link,
+// difficulty and PoW checks. All runs share one pool of a worker per core
+// but one, started on first use; the caller takes part in each window.
+struct ChainVerifier {
+  struct Progress {
+    uint64_t height; // last height checked
+    uint64_t done;   // blocks checked so far
+    uint64_t total;
+    double blocksPerSec;
+  };
+
+  struct Options {
+    uint64_t from{0};
+    uint64_t to{UINT64_MAX};  // inclusive; clamped to the tip
+    std::string assumeValid;  // block hash; "" checks everything
+    bool parallel{true};      // false checks on the calling thread only
+    // after each window, on the calling thread; returning false stops
+    std::function<bool(const Progress&)> progress;
+  };
+
+  struct Result {
+    bool ok{false};
+    uint64_t from{0}, to{0};  // range actually held and checked
+    uint64_t checked{0};      // blocks checked
+    uint64_t headersOnly{0};  // of which pruned to a header
+    uint64_t assumed{0};      // of which at or below the checkpoint
+    int64_t badHeight{-1};
+    std::string error;        // why badHeight failed, or why nothing ran
+    double seconds{0};
+    double blocksPerSec{0};
+  };
+
+  static constexpr size_t kWindow = 256; // blocks copied out of the chain at a time
+
+  static Result run(const Blockchain& chain, const Options& o);
+};
+
+}
@@ -0,0 +1,43 @@
+// include/blockchain/Snapshot.h
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/property_tree/ptree.hpp>
+#include "blockchain/Block.h"
+
+namespace QTC {
+
+// Account state after the first `height` blocks, split into chunks of at
+// most SNAPSHOT_CHUNK_ACCOUNTS accounts in address order. The manifest
+// carries the tip block and every chunk's hash; `root` commits to all of
+// them, so a chunk can be checked on arrival against the manifest alone.
+struct Snapshot {
+  uint64_t height{0};
+  std::unique_ptr<Block> tip;
+  uint64_t minted{0};
+  std::vector<std::string> chunkHashes;
+  std::string root;
+  // chunk bodies; only kept by the node serving the snapshot
+  std::vector<std::string> chunks;
+
+  static std::shared_ptr<Snapshot> build(const Block& tip, const std::map<std::string, uint64_t>& balances,
+                                         uint64_t minted);
+
+  boost::property_tree::ptree manifest() const;
+  // checks that root matches the fields and the tip block hashes correctly
+  // at the given (the chain's) difficulty. Every field is the sender's
+  // choice, so a manifest that passes is still only a claim.
+  static std::shared_ptr<Snapshot> fromManifest(const boost::property_tree::ptree& m, uint32_t difficulty);
+
+  bool checkChunk(size_t i, const std::string& data) const;
+  // appends the chunk's accounts to out; false if it is malformed
+  static bool parseChunk(const std::string& data, std::map<std::string, uint64_t>& out);
+
+  static std::string computeRoot(uint64_t height, const std::string& tipHash, uint64_t minted,
+                                 const std::vector<std::string>& chunkHashes);
+};
+
+}
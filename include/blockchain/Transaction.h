@@ -8,7 +8,9 @@ namespace QTC {
 
 class Transaction {
 public:
-  Transaction(const std::string& from, const std::string& to, uint64_t amount, uint64_t fee);
+  // proof: optional zk transfer proof (shielded transfer); empty for plain txs
+  Transaction(const std::string& from, const std::string& to, uint64_t amount, uint64_t fee,
+              const std::string& proof = "");
 
   const std::string& getId() const;
   const std::string& getFrom() const;
@@ -16,8 +18,19 @@ public:
   uint64_t getAmount() const;
   uint64_t getFee() const;
   uint64_t getTimestamp() const;
+  const std::string& getProof() const;
+  const std::string& getPubKey() const;
+  const std::string& getSignature() const;
+
+  // Signs the txid with the sender's Ed25519 key; coinbase txs stay unsigned.
+  void sign(const std::string& privKey, const std::string& pubKey);
+  // pubkey hashes to `from` and the signature over the txid verifies
+  bool verifySignature() const;
+  // the id recomputed from the fields matches the stored one
+  bool hasValidId() const;
 
   boost::property_tree::ptree toPtree() const;
+  // keeps the "id" as given (computed when absent); check hasValidId()
   static std::unique_ptr<Transaction> fromPtree(const boost::property_tree::ptree& t);
 
 private:
@@ -27,7 +40,11 @@ private:
   uint64_t amount_{0};
   uint64_t fee_{0};
   uint64_t ts_{0};
+  std::string proof_;
+  std::string pubkey_;
+  std::string sig_;
 
+  std::string calcId() const;
   void computeId();
 };
 
@@ -6,4 +6,9 @@ static constexpr uint64_t TOTAL_SUPPLY = 1000000000000ULL;
 static constexpr uint64_t BLOCK_REWARD = 10000ULL;
 static constexpr uint32_t BLOCK_TIME_SECONDS = 600U;
 static constexpr uint32_t MAX_BLOCK_SIZE = 4000000U;
+static constexpr uint64_t GENESIS_TIMESTAMP = 1735689600ULL; // 2025-01-01T00:00:00Z
+static constexpr uint32_t DEFAULT_DIFFICULTY = 4U;
+static constexpr uint64_t SNAPSHOT_INTERVAL = 1000ULL;      // blocks between state snapshots
+static constexpr uint64_t SNAPSHOT_CHUNK_ACCOUNTS = 2048ULL;
+static constexpr uint64_t MAX_CALL_GAS = 10000000ULL;       // per contract call; calls run one at a time
 }
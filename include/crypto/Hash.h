@@ -0,0 +1,54 @@
+// include/crypto/Hash.h
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace QTC {
+
+// SHA-256 for every consensus hash (txids, merkle nodes, PoW). The backend is
+// picked once at startup from what the CPU supports; every backend passes a
+// known-answer self-test before it is enabled.
+struct Hash {
+  using Digest = std::array<uint8_t, 32>;
+
+  enum class Impl { Portable, ShaNi, Avx2 };
+
+  struct Span {
+    const void* data;
+    size_t len;
+  };
+
+  static Digest sha256(const void* data, size_t len);
+  static Digest sha256(const std::string& s) { return sha256(s.data(), s.size()); }
+
+  // out[i] = sha256(in[i]). Independent messages are hashed several per call
+  // (8-way AVX2 lanes) when that backend is active.
+  static void sha256Batch(const Span* in, Digest* out, size_t n);
+  static std::vector<Digest> sha256Batch(const std::vector<std::string>& msgs);
+
+  static std::string toHex(const uint8_t* data, size_t len);
+  static std::string toHex(const Digest& d) { return toHex(d.data(), d.size()); }
+  static std::string sha256Hex(const std::string& s) { return toHex(sha256(s)); }
+  // lowercase or uppercase hex to bytes; false on odd length or a bad digit
+  static bool fromHex(const std::string& hex, std::string& out);
+  // exactly n bytes: false unless hex has 2 * n digits
+  static bool fromHex(const std::string& hex, uint8_t* out, size_t n);
+
+  // number of leading zero hex digits, i.e. toHex(d) starts with that many '0'
+  static uint32_t leadingZeroNibbles(const Digest& d);
+
+  // active backends for single messages and for batches
+  static Impl single();
+  static Impl batch();
+  static const char* name(Impl i);
+  static bool supported(Impl i);
+  // pin both paths to one backend (benchmarks); false if the CPU lacks it
+  static bool force(Impl i);
+  // back to the backends picked at startup
+  static void reset();
+};
+
+}
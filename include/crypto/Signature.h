@@ -0,0 +1,40 @@
+// include/crypto/Signature.h
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace QTC {
+
+// Ed25519 keys and signatures, all passed around as lowercase hex
+// (32-byte keys, 64-byte signatures).
+struct Signature {
+  struct KeyPair {
+    std::string priv;
+    std::string pub;
+  };
+
+  struct Item {
+    const std::string* pub;
+    const std::string* msg;
+    const std::string* sig;
+  };
+
+  static KeyPair generate();
+  static std::string sign(const std::string& priv, const std::string& msg);
+  // plain check, bypasses the cache
+  static bool verify(const std::string& pub, const std::string& msg, const std::string& sig);
+
+  // Mempool admission: like verify() but valid signatures are remembered so
+  // verifyBatch does not check them again when their block connects.
+  static bool verifyCached(const std::string& pub, const std::string& msg, const std::string& sig);
+  // Block validation: checks every item not already in the verified cache,
+  // split into chunks across the verifier pool. On failure *bad (if given)
+  // is the index of the first invalid item.
+  static bool verifyBatch(const std::vector<Item>& items, size_t* bad = nullptr);
+
+  // address owned by a public key: "QTC" + first 40 hex digits of sha256(pub)
+  static std::string address(const std::string& pub);
+};
+
+}
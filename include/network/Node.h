@@ -1,5 +1,8 @@
 #pragma once
+#include <chrono>
+#include <deque>
 #include <string>
+#include <thread>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -12,13 +15,16 @@ namespace QTC {
 class Transaction;
 class Block;
 class Blockchain;
+struct Snapshot;
 
 class P2P {
 public:
   explicit P2P(Blockchain* c);
   ~P2P();
 
+  // port 0 binds an ephemeral port; port() reports the bound one
   void listen(unsigned short port);
+  unsigned short port() const;
   void connect(const std::string& host, unsigned short port);
   void stop();
 
@@ -27,15 +33,32 @@ public:
 
   std::vector<std::string> peers() const;
 
+  // Delay every outgoing message by d (simulation of WAN links).
+  void setLinkLatency(std::chrono::milliseconds d);
+  // How long a snapshot request may go unanswered before its peer is given
+  // up on (default 10 s).
+  void setSyncTimeout(std::chrono::milliseconds d);
+
+  // wire format: one JSON object per line, {"t": <Msg>, "p": <payload>}
+  enum class Msg {
+    Hello, Inv, GetBlocks, Block, Tx, Ping, Pong,
+    GetSnapshot, Snapshot, GetChunk, Chunk
+  };
+
+  static std::string pack(Msg type, const std::string& payload);
+  static bool unpack(const std::string& line, Msg& type, std::string& payload);
+
 private:
   struct Peer {
     std::shared_ptr<boost::asio::ip::tcp::socket> sock;
     std::string remote;
-    std::string inbuf;
-  };
-
-  enum class Msg {
-    Hello, Inv, GetBlocks, Block, Tx, Ping, Pong
+    // the remote IP alone: peers sharing it may be one operator
+    std::string addr;
+    boost::asio::streambuf inbuf;
+    // touched only on the io thread
+    std::deque<std::string> outbox;
+    // lowest block the peer still has a body for (from its hello)
+    uint64_t low{0};
   };
 
   Blockchain* chain_{nullptr};
@@ -53,16 +76,47 @@ private:
   std::unordered_set<std::string> seen_block_;
   size_t max_seen_{20000};
 
+  std::chrono::milliseconds latency_{0};
+
+  // Snapshot fast-sync of a fresh node: a manifest is only trusted once
+  // peers at kSnapQuorum distinct addresses offer the same root; chunks are
+  // then requested from every peer that offers it.
+  struct SnapSync;
+  struct SnapOffer {
+    std::shared_ptr<const Snapshot> manifest;
+    std::vector<std::shared_ptr<Peer>> peers;
+  };
+  std::mutex snap_mu_;
+  std::unique_ptr<SnapSync> snap_;
+  bool snap_wanted_{false};
+  // before a quorum: manifests by root, and manifest requests unanswered
+  std::unordered_map<std::string, SnapOffer> snap_offers_;
+  size_t snap_asked_{0};
+  // while snap_wanted_: when the current manifest request went out, and a
+  // timer that retires silent peers and falls back to block sync
+  std::chrono::steady_clock::time_point snap_since_;
+  std::unique_ptr<boost::asio::steady_timer> snap_timer_;
+  std::chrono::milliseconds snap_timeout_{10000};
+
   void do_accept();
   void start_read(const std::shared_ptr<Peer>& p);
 
-  static std::string pack(Msg type, const std::string& payload);
-  static bool unpack(const std::string& line, Msg& type, std::string& payload);
-
   void on_msg(const std::shared_ptr<Peer>& p, Msg type, const std::string& payload);
   void send_line(const std::shared_ptr<Peer>& p, const std::string& line);
+  void enqueue_line(const std::shared_ptr<Peer>& p, std::string line);
+  void write_next(const std::shared_ptr<Peer>& p);
   void send_all(const std::string& line, const std::shared_ptr<Peer>& except = nullptr);
   void trim_seen();
+  void send_hello(const std::shared_ptr<Peer>& p);
+  void request_blocks(const std::shared_ptr<Peer>& p);
+  void snap_request_more(const std::shared_ptr<Peer>& p);
+  void snap_drop_peer(const std::shared_ptr<Peer>& p);
+  void snap_finish();
+  void snap_start(const SnapOffer& o);
+  void snap_abandon();
+  void snap_arm();
+  void snap_check();
+  void request_blocks_all();
 };
 
 } // namespace QTC
@@ -0,0 +1,70 @@
+// include/rpc/EventBus.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rpc/RpcServer.h"
+
+namespace QTC {
+class Block;
+class Blockchain;
+class Transaction;
+
+// Fan-out of chain events to RPC push streams. Each event is serialized
+// once and queued on every interested sink; a subscriber that falls behind
+// loses events (its sink reports Full) and then receives
+//   {"event":"dropped","count":N}
+// before the next event it does get, so it knows to resync.
+//
+// Event lines:
+//   {"event":"block","height":..,"hash":..,"prev":..,"time":..,"txs":..}
+//   {"event":"tx","id":..,"from":..,"to":..,"amount":..,"fee":..}
+//   {"event":"address","address":..,"id":..,"from":..,"to":..,"amount":..,
+//    "fee":..,"confirmed":0|1[,"height":..]}
+class EventBus {
+public:
+  enum Kind : unsigned { Blocks = 1, Txs = 2, Addresses = 4 };
+
+  struct Filter {
+    unsigned kinds{Blocks};
+    std::vector<std::string> addresses; // with Addresses
+  };
+
+  static constexpr size_t kMaxSubscribers = 1024;
+
+  // publish every block the chain connects and every tx it admits; the
+  // bus must outlive the chain
+  void attach(Blockchain& chain);
+
+  // false once kMaxSubscribers are subscribed
+  bool subscribe(const Filter& f, const std::shared_ptr<RpcServer::Sink>& sink);
+  size_t subscribers() const;
+
+  // subscribe(["block","tx","address"...], ["<address>", ...])
+  static bool parseFilter(const RpcServer::PTree& params, Filter& out);
+
+  void publishBlock(const Block& b);
+  void publishTx(const Transaction& tx);
+
+private:
+  struct Sub {
+    Filter filter;
+    std::shared_ptr<RpcServer::Sink> sink;
+    uint64_t dropped{0};
+    bool dead{false};
+  };
+
+  void deliver(Sub& s, const std::string& line);
+  void addressEvents(const Transaction& tx, bool confirmed, uint64_t height);
+  void reap();
+
+  mutable std::mutex mu_;
+  std::vector<std::unique_ptr<Sub>> subs_;
+  std::unordered_map<std::string, std::vector<Sub*>> watch_;
+};
+
+}
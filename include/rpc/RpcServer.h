@@ -1,5 +1,7 @@
 // include/rpc/RpcServer.h
 #pragma once
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <string>
@@ -12,12 +14,62 @@ namespace QTC {
 class RpcServer {
 public:
   using PTree = boost::property_tree::ptree;
+  // may throw std::invalid_argument to reject its params (-32602); any other
+  // std::exception is answered as an internal error (-32603)
   using Handler = std::function<PTree(const PTree& params)>;
+  // Sends one result object to the client; false once the client is gone,
+  // so the handler can stop producing.
+  using Emit = std::function<bool(const PTree& item)>;
+  using StreamHandler = std::function<void(const PTree& params, const Emit& emit)>;
+
+  // Write end of a long-lived push stream. push() may be called from any
+  // thread and never blocks: lines are queued (up to the subscription's
+  // bound) and written by the io threads.
+  class Sink {
+  public:
+    enum class Status { Queued, Full, Closed };
+    virtual ~Sink() = default;
+    // line is one JSON object ending in '\n'
+    virtual Status push(const std::string& line) = 0;
+    // the client went away; later pushes return Closed
+    virtual bool closed() const = 0;
+  };
+  // Keeps the sink to push to later; false refuses the subscription (429),
+  // std::invalid_argument rejects the params (-32602).
+  using SubscribeHandler = std::function<bool(const PTree& params, const std::shared_ptr<Sink>& sink)>;
+
+  // Admission class of a method. Each class has its own workers and bounded
+  // queue, so a flood of heavy calls cannot delay cheap reads.
+  enum class Cost { Cheap, Normal, Heavy };
+
+  struct Limits {
+    size_t workers;
+    size_t queue;  // calls waiting for a worker; more are rejected
+    double rate;   // calls per second per client (token bucket per IP)
+    double burst;
+  };
+  static Limits defaultLimits(Cost c);
 
   RpcServer();
   ~RpcServer();
 
-  void add(const std::string& method, Handler h);
+  void add(const std::string& method, Handler h, Cost cost = Cost::Normal);
+  // A method whose results go out as they are produced: chunked HTTP with
+  // one JSON object per line (NDJSON), no JSON-RPC envelope.
+  void addStream(const std::string& method, StreamHandler h, Cost cost = Cost::Heavy);
+  // A subscription: the response stays open as a chunked NDJSON stream
+  // that is fed through the sink. It holds no worker thread; at most
+  // `queue` lines wait for a slow client, further pushes report Full.
+  void addSubscribe(const std::string& method, SubscribeHandler h, size_t queue = 1024,
+                    Cost cost = Cost::Normal);
+  // before start()
+  void setLimits(Cost c, const Limits& l);
+  // A reply or stream write that makes no progress for this long (default
+  // 10 s) drops the client, so a reader that stalls cannot hold a worker.
+  void setWriteTimeout(std::chrono::milliseconds d);
+  // threads read requests and admit them; the class workers run the calls.
+  // A call over its client's rate or beyond a full queue gets HTTP 429 with
+  // JSON-RPC error -32005 at once.
   void start(const std::string& host, unsigned short port, int threads);
   void stop();
 
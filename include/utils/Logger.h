@@ -0,0 +1,108 @@
+// include/utils/Logger.h
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Records below this level are compiled out entirely (0 = trace ... 4 = error).
+#ifndef QTC_LOG_MIN_LEVEL
+#define QTC_LOG_MIN_LEVEL 1
+#endif
+
+namespace QTC {
+
+enum class LogLevel : uint8_t { Trace, Debug, Info, Warn, Error, Off };
+
+// Subsystem of a record; each has its own runtime threshold.
+enum class LogTag : uint8_t { Node, Chain, P2P, RPC, Zk, VM, Count };
+
+// Asynchronous logger. write() formats into a fixed-size record in a bounded
+// lock-free ring (one CAS, no allocation, no I/O); a background thread
+// drains the ring to the output. When the ring is full the record is dropped
+// and counted rather than stalling the caller.
+class Logger {
+public:
+  static constexpr size_t kMsgLen = 240;    // longer messages are truncated
+  static constexpr size_t kCapacity = 8192; // records; power of two
+
+  static Logger& instance();
+
+  // Appends to path; "" writes to stderr (the default).
+  bool open(const std::string& path);
+
+  void setLevel(LogLevel l);               // every tag
+  void setLevel(LogTag t, LogLevel l);
+  bool enabled(LogLevel l, LogTag t) const {
+    return static_cast<uint8_t>(l) >= levels_[static_cast<size_t>(t)].load(std::memory_order_relaxed);
+  }
+
+#if defined(__GNUC__)
+  __attribute__((format(printf, 4, 5)))
+#endif
+  void write(LogLevel l, LogTag t, const char* fmt, ...);
+
+  // blocks until everything written so far is on the output
+  void flush();
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  static const char* name(LogLevel l);
+  static const char* name(LogTag t);
+  // case-insensitive; false if unknown
+  static bool parse(const std::string& s, LogLevel& out);
+  static bool parse(const std::string& s, LogTag& out);
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+private:
+  Logger();
+  ~Logger();
+
+  struct Record {
+    std::atomic<uint64_t> seq;
+    uint64_t ns;  // system clock
+    LogLevel level;
+    LogTag tag;
+    uint16_t len;
+    char msg[kMsgLen];
+  };
+
+  size_t drain();
+  void run();
+
+  std::unique_ptr<Record[]> ring_;
+  alignas(64) std::atomic<uint64_t> head_{0}; // next slot producers claim
+  alignas(64) uint64_t tail_{0};              // next slot the drain thread reads
+  std::atomic<uint8_t> levels_[static_cast<size_t>(LogTag::Count)];
+  std::atomic<uint64_t> dropped_{0};
+
+  std::mutex mu_; // output, wakeups
+  std::condition_variable cv_;
+  std::condition_variable drained_;
+  FILE* out_{nullptr};
+  bool stop_{false};
+  uint64_t flush_req_{0};
+  uint64_t flush_done_{0};
+  std::thread thread_;
+};
+
+}
+
+#define QTC_LOG(level, tag, ...)                                                                     \
+  do {                                                                                              \
+    if (static_cast<int>(::QTC::LogLevel::level) >= QTC_LOG_MIN_LEVEL &&                            \
+        ::QTC::Logger::instance().enabled(::QTC::LogLevel::level, ::QTC::LogTag::tag))              \
+      ::QTC::Logger::instance().write(::QTC::LogLevel::level, ::QTC::LogTag::tag, __VA_ARGS__);     \
+  } while (0)
+
+#define QTC_TRACE(tag, ...) QTC_LOG(Trace, tag, __VA_ARGS__)
+#define QTC_DEBUG(tag, ...) QTC_LOG(Debug, tag, __VA_ARGS__)
+#define QTC_INFO(tag, ...)  QTC_LOG(Info, tag, __VA_ARGS__)
+#define QTC_WARN(tag, ...)  QTC_LOG(Warn, tag, __VA_ARGS__)
+#define QTC_ERROR(tag, ...) QTC_LOG(Error, tag, __VA_ARGS__)
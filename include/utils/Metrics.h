@@ -0,0 +1,126 @@
+// include/utils/Metrics.h
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace QTC {
+
+// Monotonic counter. inc() is a single relaxed atomic add.
+class Counter {
+public:
+  void inc(uint64_t n = 1) { v_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return v_.load(std::memory_order_relaxed); }
+private:
+  std::atomic<uint64_t> v_{0};
+};
+
+// Point-in-time value.
+class Gauge {
+public:
+  void set(double v) { v_.store(v, std::memory_order_relaxed); }
+  void add(double d) {
+    double cur = v_.load(std::memory_order_relaxed);
+    while (!v_.compare_exchange_weak(cur, cur + d, std::memory_order_relaxed)) {}
+  }
+  double value() const { return v_.load(std::memory_order_relaxed); }
+private:
+  std::atomic<double> v_{0.0};
+};
+
+// HDR-style log-linear histogram over uint64 samples: values below 16 get
+// exact buckets, above that every power of two is split into 8 linear
+// sub-buckets (~12.5% relative error). record() touches three atomics.
+class Histogram {
+public:
+  static constexpr int kSubBits = 3;
+  static constexpr int kBuckets = 16 + (64 - 4) * (1 << kSubBits);
+
+  // unit converts a raw sample to the exported unit (1e-9 for ns -> seconds);
+  // [lo_exp, hi_exp] is the range of power-of-two bucket bounds exported.
+  Histogram(double unit, int lo_exp, int hi_exp) : unit_(unit), lo_exp_(lo_exp), hi_exp_(hi_exp) {}
+
+  void record(uint64_t v) {
+    buckets_[index(v)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(v, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+  // approximate q-quantile (0..1) in raw units, upper bound of the bucket
+  uint64_t quantile(double q) const;
+
+  static int index(uint64_t v);
+  static uint64_t upperBound(int idx);
+
+private:
+  friend class Metrics;
+  std::atomic<uint64_t> buckets_[kBuckets]{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  double unit_;
+  int lo_exp_;
+  int hi_exp_;
+};
+
+// Records the elapsed nanoseconds into a histogram on scope exit.
+class ScopedTimer {
+public:
+  explicit ScopedTimer(Histogram& h) : h_(h), t0_(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() {
+    h_.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - t0_).count()));
+  }
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+private:
+  Histogram& h_;
+  std::chrono::steady_clock::time_point t0_;
+};
+
+// Process-wide registry. Lookups take a mutex, so callers resolve their
+// metrics once (static locals, route tables) and keep the reference; the
+// returned objects live for the life of the process.
+class Metrics {
+public:
+  static Metrics& instance();
+
+  // labels is a preformatted Prometheus label list, e.g. label("method", m)
+  Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+  Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+  // durations recorded in nanoseconds, exported in seconds
+  Histogram& timer(const std::string& name, const std::string& help, const std::string& labels = "");
+  // plain sizes/counts
+  Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+  static std::string label(const std::string& key, const std::string& value);
+
+  // Prometheus text exposition format 0.0.4
+  std::string render() const;
+
+private:
+  enum class Type { Counter, Gauge, Histogram };
+  struct Family {
+    Type type;
+    std::string help;
+    std::map<std::string, void*> children;
+  };
+
+  mutable std::mutex mu_;
+  std::map<std::string, Family> families_;
+  std::deque<std::unique_ptr<Counter>> counters_;
+  std::deque<std::unique_ptr<Gauge>> gauges_;
+  std::deque<std::unique_ptr<Histogram>> histograms_;
+
+  Family& family(const std::string& name, const std::string& help, Type t);
+  Histogram& make_histogram(const std::string& name, const std::string& help, const std::string& labels,
+                            double unit, int lo_exp, int hi_exp);
+};
+
+}
@@ -0,0 +1,73 @@
+// include/utils/ThreadPool.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace QTC {
+
+// Fixed-size FIFO worker pool. Tasks submitted after the destructor starts
+// are not run; the destructor drains what is already queued.
+class ThreadPool {
+public:
+  // threads == 0 uses std::thread::hardware_concurrency()
+  explicit ThreadPool(size_t threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template <class F>
+  auto submit(F&& f) -> std::future<typename std::result_of<F()>::type> {
+    using R = typename std::result_of<F()>::type;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto fut = task->get_future();
+    post([task]{ (*task)(); });
+    return fut;
+  }
+
+  // Runs fn(i) for every i in [0, n). Chunks of `grain` indices are claimed
+  // from a shared counter by the workers and by the calling thread, so a
+  // slow chunk never holds up the rest; returns once every index ran. The
+  // caller taking part also means this cannot deadlock on a busy pool.
+  template <class F>
+  void parallelFor(size_t n, size_t grain, F&& fn) {
+    if (grain == 0) grain = 1;
+    const size_t chunks = (n + grain - 1) / grain;
+    if (chunks <= 1) { for (size_t i = 0; i < n; ++i) fn(i); return; }
+    auto next = std::make_shared<std::atomic<size_t>>(0);
+    auto work = [next, chunks, grain, n, &fn]{
+      for (size_t c; (c = next->fetch_add(1)) < chunks;) {
+        size_t end = std::min(n, (c + 1) * grain);
+        for (size_t i = c * grain; i < end; ++i) fn(i);
+      }
+    };
+    std::vector<std::future<void>> helpers;
+    for (size_t h = 0; h < std::min(workers_.size(), chunks - 1); ++h) helpers.push_back(submit(work));
+    work();
+    for (auto& f : helpers) f.get();
+  }
+
+  size_t size() const { return workers_.size(); }
+
+private:
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> queue_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+
+  void post(std::function<void()> fn);
+  void run();
+};
+
+}
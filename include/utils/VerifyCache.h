@@ -0,0 +1,45 @@
+// include/utils/VerifyCache.h
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace QTC {
+class ThreadPool;
+
+// Bounded FIFO set of digests of items (signatures, proofs) that passed an
+// expensive check, so the same item is not checked again when its block
+// connects.
+class VerifyCache {
+public:
+  explicit VerifyCache(size_t max) : max_(max) {}
+
+  // raw SHA-256 of the item's canonical encoding
+  static std::string key(const std::string& item);
+
+  bool contains(const std::string& k) const;
+  void insert(const std::string& k);
+
+  // Runs check(i) for every i whose keys[i] is not cached, in chunks of
+  // about `chunk` items on the shared verifier pool (inline below two
+  // chunks). If all pass their keys are cached and true is returned;
+  // otherwise *bad (if given) is the lowest failing index.
+  bool verifyBatch(const std::vector<std::string>& keys, size_t chunk, const std::function<bool(size_t)>& check,
+                   size_t* bad = nullptr);
+
+private:
+  const size_t max_;
+  mutable std::mutex mu_;
+  std::unordered_set<std::string> set_;
+  std::deque<std::string> order_;
+};
+
+// one pool for all block validation work; kept apart from the zk prover
+// pool so long proofs never delay it
+ThreadPool& verifier_pool();
+
+}
@@ -0,0 +1,105 @@
+// include/vm/VM.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace QTC {
+
+// Register-based contract bytecode. Every instruction is 8 bytes:
+//   op, a, b, c (register indices), imm (signed 32-bit)
+// a is the destination unless noted; jump targets are instruction indices.
+//
+//   name     gas   effect
+#define QTC_VM_OPS(X)                                                   \
+  X(Halt,     1)  /* stop, result r0                               */  \
+  X(Ret,      1)  /* stop, result ra                               */  \
+  X(LoadI,    1)  /* ra = sign-extended imm                        */  \
+  X(LoadHi,   1)  /* ra = (ra & 0xffffffff) | uint32(imm) << 32    */  \
+  X(Mov,      1)  /* ra = rb                                       */  \
+  X(Add,      1)  /* ra = rb + rc                                  */  \
+  X(AddI,     1)  /* ra = rb + imm                                 */  \
+  X(Sub,      1)  /* ra = rb - rc                                  */  \
+  X(Mul,      2)  /* ra = rb * rc                                  */  \
+  X(Div,      4)  /* ra = rb / rc, 0 if rc == 0                    */  \
+  X(Mod,      4)  /* ra = rb % rc, 0 if rc == 0                    */  \
+  X(And,      1)                                                       \
+  X(Or,       1)                                                       \
+  X(Xor,      1)                                                       \
+  X(Shl,      1)  /* ra = rb << (rc & 63)                          */  \
+  X(Shr,      1)  /* ra = rb >> (rc & 63)                          */  \
+  X(Eq,       1)  /* ra = rb == rc                                 */  \
+  X(Lt,       1)  /* ra = rb < rc (unsigned)                       */  \
+  X(Jmp,      1)  /* goto imm                                      */  \
+  X(Jz,       1)  /* if ra == 0 goto imm                           */  \
+  X(Jnz,      1)  /* if ra != 0 goto imm                           */  \
+  X(SLoad,   50)  /* ra = storage[rb]                              */  \
+  X(SStore, 200)  /* storage[ra] = rb                              */
+
+enum class Op : uint8_t {
+#define QTC_VM_ENUM(name, gas) name,
+  QTC_VM_OPS(QTC_VM_ENUM)
+#undef QTC_VM_ENUM
+  Count
+};
+
+struct Instr {
+  uint8_t op;
+  uint8_t a, b, c;
+  int32_t imm;
+};
+
+// Contract storage: 64-bit words keyed by 64-bit words.
+class Storage {
+public:
+  virtual ~Storage() = default;
+  virtual uint64_t load(uint64_t key) = 0;
+  virtual void store(uint64_t key, uint64_t value) = 0;
+};
+
+// Bytecode that passed verification. Only verified programs can run, which
+// is what lets the interpreter skip bounds checks on registers, opcodes and
+// jump targets.
+class Program {
+public:
+  // Deploy-time check: known opcodes, register indices below kRegs, jump
+  // targets inside the code and a final Halt/Ret/Jmp so execution can never
+  // run off the end. Returns nullptr (and the reason in *err) otherwise.
+  static std::unique_ptr<Program> verify(std::vector<Instr> code, std::string* err = nullptr);
+
+  // 8 bytes per instruction, imm little-endian
+  static bool decode(const std::string& bytes, std::vector<Instr>& out);
+  static std::string encode(const std::vector<Instr>& code);
+
+  const std::vector<Instr>& code() const { return code_; }
+
+private:
+  explicit Program(std::vector<Instr> code) : code_(std::move(code)) {}
+  std::vector<Instr> code_;
+};
+
+struct VM {
+  static constexpr size_t kRegs = 16;
+  static constexpr size_t kMaxCode = 65536;
+
+  enum class Status { Ok, OutOfGas };
+
+  struct Result {
+    Status status;
+    uint64_t value;
+    uint64_t gasUsed;
+  };
+
+  // Runs p with args in r0..r(n-1) (at most kRegs, the rest are zero).
+  // Out of gas uses up the whole limit; the caller decides whether to keep
+  // the storage writes made before that.
+  static Result run(const Program& p, Storage& s, uint64_t gasLimit,
+                    const uint64_t* args = nullptr, size_t nargs = 0);
+
+  static const char* name(Op op);
+  static uint32_t gas(Op op);
+};
+
+}
@@ -1,14 +1,82 @@
 // include/wallet/Wallet.h
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include "crypto/Signature.h"
 
 namespace QTC {
+class Block;
+class Blockchain;
+class Transaction;
 
+// Owned keys, kept in a hash map by address, and the confirmed balance and
+// history of those addresses. Balances follow the chain block by block (the
+// same transfer rule the chain applies), so reading them never scans the
+// chain or the key set.
+//
+// Keys persist in <dir>/keys, one "<priv hex> <pub hex>" line each; a new
+// key is on disk before create() returns it. History is not persisted: it
+// is rebuilt as the chain is replayed.
 class Wallet {
 public:
-  static std::string Create();
-  static const std::vector<std::string>& All();
+  struct Tx {
+    std::string id;
+    uint64_t height;
+    std::string from, to;
+    uint64_t amount, fee;
+  };
+
+  static constexpr size_t kMaxHistory = 10000; // most recent entries kept
+
+  // Loads the key file in dir, creating dir if needed; false if the file
+  // exists but cannot be read or has a malformed line. "" keeps keys in
+  // memory only.
+  bool open(const std::string& dir);
+
+  // follow every block the chain connects; the wallet must outlive the chain
+  void attach(Blockchain& chain);
+
+  // new Ed25519 key; the address is derived from its public key. "" if the
+  // key could not be persisted.
+  std::string create();
+  std::vector<std::string> addresses() const; // in creation order
+  bool owns(const std::string& address) const;
+  // signs tx with the key of its sender; false if that address is not ours
+  // or no signature could be made
+  bool sign(Transaction& tx) const;
+
+  uint64_t balance() const;                          // whole wallet
+  uint64_t balance(const std::string& address) const; // 0 if not ours
+  // an owned address whose balance, less what its transactions still in
+  // the attached chain's mempool spend, covers need; "" if none
+  std::string spendable(uint64_t need) const;
+  // most recent first
+  std::vector<Tx> transactions(size_t max) const;
+
+private:
+  struct Entry {
+    Signature::KeyPair key;
+    uint64_t balance{0};
+  };
+
+  void onBlock(const Block& b);
+  void rescan();
+  bool persist(const Signature::KeyPair& kp);
+
+  mutable std::mutex mu_;
+  std::string path_;
+  std::unordered_map<std::string, Entry> keys_;
+  std::vector<std::string> order_;
+  uint64_t total_{0};
+  std::deque<Tx> history_;
+  Blockchain* chain_{nullptr};
+  // index of the last block reflected in the balances, -1 before attach
+  int64_t synced_{-1};
 };
 
 }
@@ -1,11 +1,30 @@
 #pragma once
+#include <cstddef>
+#include <future>
 #include <string>
+#include <vector>
 
 namespace QTC {
 
 struct Zk {
+  // Loads the transfer circuit keys from keyDir (memory-mapped), generating
+  // and writing them there on first run, and starts `threads` prover threads
+  // (0 = one per core). Proving before setup() falls back to in-memory keys.
+  static bool setup(const std::string& keyDir, size_t threads = 0);
+
   static bool prove_transfer(const std::string& note, std::string& proof);
+  // Runs prove_transfer on the prover pool; the future yields the proof, or
+  // an empty string if proving failed.
+  static std::future<std::string> prove_transfer_async(const std::string& note);
+  // Single proof check (mempool admission). Valid proofs are remembered so
+  // verify_transfer_batch does not check them again when their block connects.
   static bool verify_transfer(const std::string& proof);
+  // Block validation: checks every proof not already in the verified cache,
+  // split into chunks across the verifier pool. Each proof still gets its
+  // own pairing check; there is no randomized linear combination, since
+  // r1cs_ppzksnark has no batch verifier. On failure *bad (if given) is the
+  // index of the first invalid proof.
+  static bool verify_transfer_batch(const std::vector<std::string>& proofs, size_t* bad = nullptr);
 };
 
 } // namespace QTC
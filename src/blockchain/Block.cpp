@@ -1,21 +1,18 @@
 #include "blockchain/Block.h"
 #include "blockchain/Transaction.h"
-#include <openssl/sha.h>
-#include <sstream>
-#include <iomanip>
+#include "crypto/Hash.h"
+#include "utils/Metrics.h"
+#include <chrono>
+#include <cstring>
 #include <ctime>
 
 using pt = boost::property_tree::ptree;
 
 namespace QTC {
 
-static std::string sha256(const std::string& s) {
-  unsigned char h[SHA256_DIGEST_LENGTH];
-  SHA256(reinterpret_cast<const unsigned char*>(s.data()), s.size(), h);
-  std::ostringstream o;
-  for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i)
-    o << std::hex << std::setw(2) << std::setfill('0') << (int)h[i];
-  return o.str();
+// header hash input: index ts prev merkle nonce diff as decimal text
+static std::string headerPrefix(uint32_t index, uint64_t ts, const std::string& prev, const std::string& merkle) {
+  return std::to_string(index) + std::to_string(ts) + prev + merkle;
 }
 
 Block::Block(uint32_t idx, const std::string& prev, uint32_t diff)
@@ -23,38 +20,73 @@ Block::Block(uint32_t idx, const std::string& prev, uint32_t diff)
   ts_ = static_cast<uint64_t>(std::time(nullptr));
 }
 
+Block::Block(uint32_t idx, const std::string& prev, uint32_t diff, uint64_t ts)
+  : index_(idx), ts_(ts), prev_(prev), diff_(diff) {}
+
 void Block::addTransaction(const Transaction& tx) { txs_.push_back(tx); }
 
-void Block::calcMerkle() {
+std::string Block::merkleRoot(const std::vector<Transaction>& txs) {
   std::vector<std::string> h;
-  for (auto& t : txs_) h.push_back(t.getId());
-  if (h.empty()) { merkle_.clear(); return; }
+  for (auto& t : txs) h.push_back(t.getId());
+  if (h.empty()) return "";
+  // each level is one batch: the node pairs are independent messages
+  std::vector<std::string> cat;
   while (h.size() > 1) {
-    std::vector<std::string> n;
+    cat.clear();
     for (size_t i = 0; i < h.size(); i += 2) {
       const std::string& a = h[i];
       const std::string& b = (i + 1 < h.size()) ? h[i + 1] : h[i];
-      n.push_back(sha256(a + b));
+      cat.push_back(a + b);
     }
-    h.swap(n);
+    auto d = Hash::sha256Batch(cat);
+    h.resize(d.size());
+    for (size_t i = 0; i < d.size(); ++i) h[i] = Hash::toHex(d[i]);
   }
-  merkle_ = h[0];
+  return h[0];
 }
 
+void Block::calcMerkle() { merkle_ = merkleRoot(txs_); }
+
 std::string Block::calcHash() const {
-  std::ostringstream s;
-  s << index_ << ts_ << prev_ << merkle_ << nonce_ << diff_;
-  return sha256(s.str());
+  return Hash::sha256Hex(headerPrefix(index_, ts_, prev_, merkle_) + std::to_string(nonce_) + std::to_string(diff_));
 }
 
 void Block::mine() {
+  static Counter& hashes = Metrics::instance().counter("qtc_mining_hashes_total", "Header hashes computed while mining");
+  static Counter& mined = Metrics::instance().counter("qtc_mining_blocks_total", "Blocks mined locally");
+  static Gauge& rate = Metrics::instance().gauge("qtc_mining_hashrate", "Hashes per second over the last mined block");
+  static Histogram& dur = Metrics::instance().timer("qtc_mining_block_duration_seconds", "Wall time to mine one block");
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint32_t start = nonce_;
   calcMerkle();
-  std::string target(diff_, '0');
+  // Same bytes as calcHash(), but the fixed parts are laid out once and only
+  // the nonce digits are rewritten; the target is checked on the raw digest.
+  const std::string prefix = headerPrefix(index_, ts_, prev_, merkle_);
+  const std::string suffix = std::to_string(diff_);
+  std::vector<char> buf(prefix.size() + 10 + suffix.size());
+  std::memcpy(buf.data(), prefix.data(), prefix.size());
+  char* digits = buf.data() + prefix.size();
+  Hash::Digest d;
   for (;;) {
     ++nonce_;
-    hash_ = calcHash();
-    if (hash_.substr(0, diff_) == target) break;
+    char tmp[10];
+    size_t nd = 0;
+    uint32_t v = nonce_;
+    do { tmp[nd++] = static_cast<char>('0' + v % 10); v /= 10; } while (v);
+    for (size_t i = 0; i < nd; ++i) digits[i] = tmp[nd - 1 - i];
+    std::memcpy(digits + nd, suffix.data(), suffix.size());
+    d = Hash::sha256(buf.data(), prefix.size() + nd + suffix.size());
+    if (Hash::leadingZeroNibbles(d) >= diff_) break;
   }
+  hash_ = Hash::toHex(d);
+
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+  uint64_t n = static_cast<uint32_t>(nonce_ - start);
+  hashes.inc(n);
+  mined.inc();
+  dur.record(static_cast<uint64_t>(ns));
+  if (ns > 0) rate.set(static_cast<double>(n) * 1e9 / static_cast<double>(ns));
 }
 
 const std::string& Block::getHash() const { return hash_; }
@@ -62,6 +94,8 @@ const std::string& Block::getPrev() const { return prev_; }
 uint32_t Block::getIndex() const { return index_; }
 uint32_t Block::getDifficulty() const { return diff_; }
 uint64_t Block::getTimestamp() const { return ts_; }
+uint32_t Block::getNonce() const { return nonce_; }
+const std::string& Block::getMerkle() const { return merkle_; }
 const std::vector<Transaction>& Block::getTransactions() const { return txs_; }
 
 pt Block::toPtree() const {
@@ -95,4 +129,41 @@ std::unique_ptr<Block> Block::fromPtree(const pt& b) {
 
 void Block::setHashForImport(const std::string& h) { hash_ = h; }
 
+static Hash::Digest digestOf(const std::string& hex) {
+  Hash::Digest d{};
+  std::string raw;
+  if (Hash::fromHex(hex, raw) && raw.size() == d.size()) std::memcpy(d.data(), raw.data(), d.size());
+  return d;
+}
+
+BlockHeader Block::header() const {
+  BlockHeader h;
+  h.index = index_;
+  h.diff = diff_;
+  h.nonce = nonce_;
+  h.ts = ts_;
+  h.prev = digestOf(prev_);
+  h.merkle = digestOf(merkle_);
+  h.hash = digestOf(hash_);
+  return h;
+}
+
+std::string BlockHeader::prevHex() const { return index == 0 ? "0" : Hash::toHex(prev); }
+
+std::string BlockHeader::merkleHex() const { return merkle == Hash::Digest{} ? "" : Hash::toHex(merkle); }
+
+bool BlockHeader::hasValidHash() const {
+  Hash::Digest d = Hash::sha256(headerPrefix(index, ts, prevHex(), merkleHex()) + std::to_string(nonce) +
+                                std::to_string(diff));
+  return d == hash && Hash::leadingZeroNibbles(d) >= diff;
+}
+
+bool Block::hasValidMerkle() const { return merkleRoot(txs_) == merkle_; }
+
+bool Block::hasValidHash() const {
+  if (!hasValidMerkle()) return false;
+  if (calcHash() != hash_) return false;
+  return hash_.size() >= diff_ && hash_.compare(0, diff_, std::string(diff_, '0')) == 0;
+}
+
 }
@@ -1,105 +1,545 @@
 #include "blockchain/Blockchain.h"
 #include "blockchain/Block.h"
+#include "blockchain/Snapshot.h"
 #include "blockchain/Transaction.h"
 #include "config/Constants.h"
+#include "crypto/Hash.h"
+#include "crypto/Signature.h"
 #include "network/Node.h"
+#include "utils/Metrics.h"
+#include "utils/ThreadPool.h"
+#include "zk/Zk.h"
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace QTC {
 
-Blockchain::Blockchain() { createGenesisBlock(); }
+namespace {
+struct ChainMetrics {
+  Counter& tx_accepted = Metrics::instance().counter("qtc_chain_transactions_total", "Transactions offered to the mempool", Metrics::label("result", "accepted"));
+  Counter& tx_rejected = Metrics::instance().counter("qtc_chain_transactions_total", "Transactions offered to the mempool", Metrics::label("result", "rejected"));
+  Histogram& tx_admit = Metrics::instance().timer("qtc_chain_tx_admit_duration_seconds", "addTransaction latency");
+  Counter& blk_local = Metrics::instance().counter("qtc_chain_blocks_connected_total", "Blocks appended to the chain", Metrics::label("source", "local"));
+  Counter& blk_peer = Metrics::instance().counter("qtc_chain_blocks_connected_total", "Blocks appended to the chain", Metrics::label("source", "peer"));
+  Counter& blk_rejected = Metrics::instance().counter("qtc_chain_blocks_rejected_total", "Peer blocks that did not extend the tip");
+  Histogram& blk_connect = Metrics::instance().timer("qtc_chain_block_connect_duration_seconds", "addBlockFromPeer latency");
+  Histogram& blk_txs = Metrics::instance().histogram("qtc_chain_block_transactions", "Transactions per connected block");
+  Gauge& height = Metrics::instance().gauge("qtc_chain_height", "Number of blocks in the chain");
+  Gauge& base = Metrics::instance().gauge("qtc_chain_base_height", "Oldest block whose body is held");
+  Gauge& mempool = Metrics::instance().gauge("qtc_chain_mempool_size", "Pending transactions");
+  Counter& bad_proofs = Metrics::instance().counter("qtc_chain_invalid_proofs_total", "Transactions or blocks rejected for an invalid zk proof");
+  Counter& bad_sigs = Metrics::instance().counter("qtc_chain_invalid_signatures_total", "Transactions or blocks rejected for an invalid signature");
+};
+ChainMetrics& chain_metrics() { static ChainMetrics m; return m; }
+
+// Blocks below this size, or whose conflict layers average fewer txs than
+// kMinLayerWidth, are applied serially: scheduling would cost more than it saves.
+constexpr size_t kParallelMinTxs = 256;
+constexpr size_t kMinLayerWidth = 64;
+constexpr size_t kApplyGrain = 32;
+
+// The balance effect of one transfer. Both execution paths go through here,
+// so they agree bit for bit. from is null for coinbase.
+inline void apply_transfer(uint64_t* from, uint64_t& to, const Transaction& tx) {
+  if (from) {
+    uint64_t spend = tx.getAmount() + tx.getFee();
+    if (*from >= spend) *from -= spend; else *from = 0;
+  }
+  uint64_t addv = to + tx.getAmount();
+  to = (addv < to) ? UINT64_MAX : addv;
+}
+
+// Contract storage seen through a write buffer: loads check the buffer
+// first, and the writes reach the chain only if the call completes.
+class BufferedStorage : public Storage {
+public:
+  explicit BufferedStorage(std::map<uint64_t, uint64_t>& base) : base_(base) {}
+  uint64_t load(uint64_t key) override {
+    auto w = writes_.find(key);
+    if (w != writes_.end()) return w->second;
+    auto it = base_.find(key);
+    return it != base_.end() ? it->second : 0;
+  }
+  void store(uint64_t key, uint64_t value) override { writes_[key] = value; }
+  void commit() {
+    for (const auto& kv : writes_) {
+      if (kv.second) base_[kv.first] = kv.second; else base_.erase(kv.first);
+    }
+  }
+private:
+  std::map<uint64_t, uint64_t>& base_;
+  std::map<uint64_t, uint64_t> writes_;
+};
+}
+
+// A copy of the state at a snapshot height, taken under mu_; chunking and
+// hashing happen after the lock is released.
+struct Blockchain::SnapshotSource {
+  Block tip;
+  std::map<std::string, uint64_t> balances;
+  uint64_t minted;
+};
+
+Blockchain::Blockchain(uint32_t difficulty) : difficulty_(difficulty) {
+  setExecutionThreads(0);
+  createGenesisBlock();
+  chain_metrics().height.set(static_cast<double>(height()));
+}
+
+Blockchain::~Blockchain() = default;
+
+void Blockchain::setExecutionThreads(size_t n) {
+  if (n == 0) n = std::thread::hardware_concurrency();
+  std::lock_guard<std::mutex> lk(mu_);
+  // the connecting thread works too, so n threads need n - 1 workers
+  exec_pool_.reset(n > 1 ? new ThreadPool(n - 1) : nullptr);
+}
 
 void Blockchain::createGenesisBlock() {
-  auto g = std::unique_ptr<Block>(new Block(0, "0", difficulty_));
+  // fixed timestamp so every node derives the same genesis hash
+  auto g = std::unique_ptr<Block>(new Block(0, "0", difficulty_, GENESIS_TIMESTAMP));
   g->mine();
   chain_.push_back(std::move(g));
 }
 
-Block* Blockchain::getLatestBlock() { return chain_.back().get(); }
+std::unique_ptr<Block> Blockchain::getLatestBlock() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return std::unique_ptr<Block>(new Block(*chain_.back()));
+}
+
+std::string Blockchain::getTipHash() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return chain_.back()->getHash();
+}
 
-uint64_t Blockchain::getBlockCount() const { return static_cast<uint64_t>(chain_.size()); }
+uint64_t Blockchain::getBlockCount() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return height();
+}
 
 bool Blockchain::validAddress(const std::string& a) const {
   return a.size() >= 8 && a.rfind("QTC", 0) == 0;
 }
 
-void Blockchain::addTransaction(const Transaction& tx) {
-  if (!validAddress(tx.getFrom())) return;
-  if (!validAddress(tx.getTo())) return;
-  if (tx.getFrom() == "COINBASE") return;
-  if (tx.getAmount() == 0) return;
+bool Blockchain::addTransaction(const Transaction& tx) {
+  auto& m = chain_metrics();
+  ScopedTimer timer(m.tx_admit);
+  if (!validAddress(tx.getFrom())) { m.tx_rejected.inc(); return false; }
+  if (!validAddress(tx.getTo())) { m.tx_rejected.inc(); return false; }
+  if (tx.getFrom() == "COINBASE") { m.tx_rejected.inc(); return false; }
+  if (tx.getAmount() == 0) { m.tx_rejected.inc(); return false; }
+  if (!tx.hasValidId()) { m.tx_rejected.inc(); return false; }
+  if (!tx.verifySignature()) { m.bad_sigs.inc(); m.tx_rejected.inc(); return false; }
+  if (!tx.getProof().empty() && !Zk::verify_transfer(tx.getProof())) {
+    m.bad_proofs.inc(); m.tx_rejected.inc(); return false;
+  }
   uint64_t need = tx.getAmount() + tx.getFee();
-  uint64_t bal = 0;
-  auto it = balances_.find(tx.getFrom());
-  if (it != balances_.end()) bal = it->second;
-  if (bal < need) return;
-  pending_.push_back(tx);
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    uint64_t bal = 0;
+    auto it = balances_.find(tx.getFrom());
+    if (it != balances_.end()) bal = it->second;
+    if (bal < need) { m.tx_rejected.inc(); return false; }
+    pending_.push_back(tx);
+    m.tx_accepted.inc();
+    m.mempool.set(static_cast<double>(pending_.size()));
+  }
+  notifyTx(tx);
   if (p2p_) p2p_->broadcastTx(tx);
+  return true;
 }
 
 void Blockchain::minePendingTransactions(const std::string& minerAddress) {
   if (mining_.exchange(true)) return;
-  auto nb = std::unique_ptr<Block>(new Block(static_cast<uint32_t>(chain_.size()), getLatestBlock()->getHash(), difficulty_));
-  Transaction coin("COINBASE", minerAddress, BLOCK_REWARD, 0);
-  nb->addTransaction(coin);
-  for (const auto& t : pending_) nb->addTransaction(t);
+  std::unique_ptr<Block> nb;
+  std::unique_ptr<SnapshotSource> snap;
+  size_t taken = 0;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    nb.reset(new Block(static_cast<uint32_t>(height()), chain_.back()->getHash(), difficulty_));
+    Transaction coin("COINBASE", minerAddress, BLOCK_REWARD, 0);
+    nb->addTransaction(coin);
+    for (const auto& t : pending_) nb->addTransaction(t);
+    taken = pending_.size();
+  }
+  // mine without the lock so peers and RPC readers are not stalled
   nb->mine();
-  updateBalances(nb.get());
-  chain_.push_back(std::move(nb));
-  pending_.clear();
-  if (p2p_ && chain_.back()) p2p_->broadcastBlock(*chain_.back());
+  Block* connected = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    // a peer block extended the tip meanwhile; our candidate is stale
+    if (nb->getIndex() == height() && nb->getPrev() == chain_.back()->getHash()) {
+      updateBalances(nb.get());
+      chain_.push_back(std::move(nb));
+      connected = chain_.back().get();
+      // pending_ is only appended to while we mine, so the mined txs are its prefix
+      pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(std::min(taken, pending_.size())));
+      auto& m = chain_metrics();
+      m.blk_local.inc();
+      m.blk_txs.record(connected->getTransactions().size());
+      m.height.set(static_cast<double>(height()));
+      m.mempool.set(static_cast<double>(pending_.size()));
+      snap = snapshotDue();
+      prune();
+    }
+  }
+  if (snap) publishSnapshot(std::move(snap));
+  if (connected) {
+    notifyBlock(*connected);
+    if (p2p_) p2p_->broadcastBlock(*connected);
+  }
   mining_ = false;
 }
 
-void Blockchain::updateBalances(Block* block) {
-  for (const auto& tx : block->getTransactions()) {
+void Blockchain::applySerial(const std::vector<Transaction>& txs) {
+  for (const auto& tx : txs) {
+    uint64_t* from = nullptr;
     if (tx.getFrom() != "COINBASE") {
-      auto& fb = balances_[tx.getFrom()];
-      uint64_t spend = tx.getAmount() + tx.getFee();
-      if (fb >= spend) fb -= spend; else fb = 0;
+      from = &balances_[tx.getFrom()];
     } else {
       uint64_t newMint = minted_ + tx.getAmount();
       minted_ = (newMint > TOTAL_SUPPLY) ? TOTAL_SUPPLY : newMint;
     }
-    auto& tb = balances_[tx.getTo()];
-    uint64_t addv = tb + tx.getAmount();
-    tb = (addv < tb) ? UINT64_MAX : addv;
+    apply_transfer(from, balances_[tx.getTo()], tx);
+  }
+}
+
+// Parallel execution. Every tx touches at most two accounts (from, to) and
+// its effect on each depends only on that account's balance, so any order
+// that keeps the per-account sequence of serial execution yields the same
+// state. Each tx goes into the layer after the last one that touched any of
+// its accounts; the txs within a layer are disjoint and run concurrently,
+// layer after layer.
+void Blockchain::updateBalances(Block* block) {
+  const auto& txs = block->getTransactions();
+  if (!exec_pool_ || txs.size() < kParallelMinTxs) { applySerial(txs); return; }
+
+  // Resolve every account serially first. The map is not modified after
+  // this, so workers only write through these (stable) node pointers.
+  struct Access { uint64_t* from; uint64_t* to; };
+  std::vector<Access> acc(txs.size());
+  std::vector<uint32_t> layer(txs.size());
+  std::unordered_map<const uint64_t*, uint32_t> next_layer;
+  next_layer.reserve(2 * txs.size());
+  uint32_t layers = 0;
+  for (size_t i = 0; i < txs.size(); ++i) {
+    const auto& tx = txs[i];
+    acc[i].from = tx.getFrom() != "COINBASE" ? &balances_[tx.getFrom()] : nullptr;
+    acc[i].to = &balances_[tx.getTo()];
+    uint32_t l = 0;
+    for (const uint64_t* p : {acc[i].from, acc[i].to}) {
+      if (!p) continue;
+      auto it = next_layer.find(p);
+      if (it != next_layer.end()) l = std::max(l, it->second);
+    }
+    for (const uint64_t* p : {acc[i].from, acc[i].to}) if (p) next_layer[p] = l + 1;
+    layer[i] = l;
+    layers = std::max(layers, l + 1);
+  }
+  // a hot account chains most txs together; fall back rather than run
+  // many nearly empty layers (the zero entries inserted above are what
+  // serial execution would insert anyway)
+  if (static_cast<size_t>(layers) * kMinLayerWidth > txs.size()) { applySerial(txs); return; }
+
+  for (const auto& tx : txs) {
+    if (tx.getFrom() != "COINBASE") continue;
+    uint64_t newMint = minted_ + tx.getAmount();
+    minted_ = (newMint > TOTAL_SUPPLY) ? TOTAL_SUPPLY : newMint;
+  }
+
+  // counting sort of tx indices by layer, keeping block order inside a layer
+  std::vector<size_t> start(layers + 1, 0);
+  for (uint32_t l : layer) ++start[l + 1];
+  for (uint32_t l = 0; l < layers; ++l) start[l + 1] += start[l];
+  std::vector<size_t> order(txs.size());
+  {
+    std::vector<size_t> pos(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < txs.size(); ++i) order[pos[layer[i]]++] = i;
+  }
+
+  for (uint32_t l = 0; l < layers; ++l) {
+    const size_t* ids = order.data() + start[l];
+    exec_pool_->parallelFor(start[l + 1] - start[l], kApplyGrain, [&](size_t k) {
+      size_t i = ids[k];
+      apply_transfer(acc[i].from, *acc[i].to, txs[i]);
+    });
   }
 }
 
 uint64_t Blockchain::getBalance(const std::string& addr) const {
+  std::lock_guard<std::mutex> lk(mu_);
   auto it = balances_.find(addr);
   return (it != balances_.end()) ? it->second : 0ULL;
 }
 
+uint64_t Blockchain::getBalances(const std::vector<std::string>& addrs, std::vector<uint64_t>& out) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  out.clear();
+  out.reserve(addrs.size());
+  for (const auto& a : addrs) {
+    auto it = balances_.find(a);
+    out.push_back(it != balances_.end() ? it->second : 0ULL);
+  }
+  return height();
+}
+
 bool Blockchain::isChainValid() {
+  std::lock_guard<std::mutex> lk(mu_);
+  // pruned history: the header chain, then its link to the oldest body
+  for (size_t i = 1; i < headers_.size(); ++i) {
+    if (headers_[i].index != headers_[i-1].index + 1 || headers_[i].prev != headers_[i-1].hash) return false;
+  }
+  if (!headers_.empty() && chain_.front()->getPrev() != Hash::toHex(headers_.back().hash)) return false;
   for (size_t i = 1; i < chain_.size(); ++i) {
     if (chain_[i]->getPrev() != chain_[i-1]->getHash()) return false;
   }
   return true;
 }
 
-const Transaction* Blockchain::getPendingById(const std::string& id) const {
-  for (const auto& t : pending_) if (t.getId() == id) return &t;
-  return nullptr;
+uint64_t Blockchain::copyRange(uint64_t from, size_t max, std::vector<BlockHeader>& headers,
+                              std::vector<std::unique_ptr<Block>>& bodies) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  headers.clear();
+  bodies.clear();
+  uint64_t first = std::max(from, hdr_base_);
+  uint64_t end = std::min(height(), first + std::min<uint64_t>(max, UINT64_MAX - first));
+  uint64_t k = first;
+  for (; k < end && k < base_; ++k) headers.push_back(headers_[k - hdr_base_]);
+  for (; k < end; ++k) bodies.emplace_back(new Block(*chain_[k - base_]));
+  return first;
+}
+
+bool Blockchain::findHeight(const std::string& hash, uint64_t& h) const {
+  std::string raw;
+  bool digest = Hash::fromHex(hash, raw) && raw.size() == sizeof(Hash::Digest);
+  std::lock_guard<std::mutex> lk(mu_);
+  for (size_t i = 0; i < chain_.size(); ++i)
+    if (chain_[i]->getHash() == hash) { h = base_ + i; return true; }
+  if (!digest) return false;
+  for (size_t i = 0; i < headers_.size(); ++i)
+    if (std::memcmp(headers_[i].hash.data(), raw.data(), raw.size()) == 0) { h = hdr_base_ + i; return true; }
+  return false;
+}
+
+std::optional<Transaction> Blockchain::getPendingById(const std::string& id) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  for (const auto& t : pending_) if (t.getId() == id) return t;
+  return std::nullopt;
+}
+
+void Blockchain::getPendingSpends(const std::vector<std::string>& addrs, std::vector<uint64_t>& out) const {
+  std::unordered_map<std::string, size_t> at;
+  for (size_t i = 0; i < addrs.size(); ++i) at.emplace(addrs[i], i);
+  out.assign(addrs.size(), 0);
+  std::lock_guard<std::mutex> lk(mu_);
+  for (const auto& t : pending_) {
+    auto it = at.find(t.getFrom());
+    if (it == at.end()) continue;
+    uint64_t& sum = out[it->second];
+    uint64_t addv = sum + t.getAmount() + t.getFee();
+    sum = (addv < sum) ? UINT64_MAX : addv;
+  }
 }
 
 std::unique_ptr<Block> Blockchain::getBlockCopyByIndex(uint64_t i) {
-  if (i >= chain_.size()) return nullptr;
-  return std::unique_ptr<Block>(new Block(*chain_[i]));
+  std::lock_guard<std::mutex> lk(mu_);
+  // below base_ the body was pruned or never downloaded (snapshot sync)
+  if (i < base_ || i >= height()) return nullptr;
+  return std::unique_ptr<Block>(new Block(*chain_[i - base_]));
+}
+
+bool Blockchain::validProofs(const Block& b) const {
+  std::vector<std::string> proofs;
+  for (const auto& tx : b.getTransactions())
+    if (!tx.getProof().empty()) proofs.push_back(tx.getProof());
+  if (proofs.empty()) return true;
+  return Zk::verify_transfer_batch(proofs);
+}
+
+bool Blockchain::validSignatures(const Block& b) const {
+  std::vector<Signature::Item> items;
+  for (const auto& tx : b.getTransactions()) {
+    if (tx.getFrom() == "COINBASE") continue;
+    if (tx.getSignature().empty() || Signature::address(tx.getPubKey()) != tx.getFrom()) return false;
+    items.push_back(Signature::Item{&tx.getPubKey(), &tx.getId(), &tx.getSignature()});
+  }
+  return items.empty() || Signature::verifyBatch(items);
 }
 
 bool Blockchain::addBlockFromPeer(const Block& b) {
-  if (b.getIndex() != chain_.size()) return false;
-  if (b.getPrev() != getLatestBlock()->getHash()) return false;
-  auto nb = std::unique_ptr<Block>(new Block(b));
-  updateBalances(nb.get());
-  chain_.push_back(std::move(nb));
+  auto& m = chain_metrics();
+  std::unique_ptr<SnapshotSource> snap;
+  {
+    ScopedTimer timer(m.blk_connect);
+    // signatures and proofs are checked before taking the lock; the ones seen
+    // at mempool admission are served from the verified caches; they are
+    // over the txid, so the ids must match the fields first
+    if (b.getDifficulty() != difficulty_ || !b.hasValidHash()) { m.blk_rejected.inc(); return false; }
+    for (const auto& tx : b.getTransactions())
+      if (!tx.hasValidId()) { m.blk_rejected.inc(); return false; }
+    if (!validSignatures(b)) { m.bad_sigs.inc(); m.blk_rejected.inc(); return false; }
+    if (!validProofs(b)) { m.bad_proofs.inc(); m.blk_rejected.inc(); return false; }
+    std::lock_guard<std::mutex> lk(mu_);
+    if (b.getIndex() != height()) { m.blk_rejected.inc(); return false; }
+    if (b.getPrev() != chain_.back()->getHash()) { m.blk_rejected.inc(); return false; }
+    auto nb = std::unique_ptr<Block>(new Block(b));
+    updateBalances(nb.get());
+    chain_.push_back(std::move(nb));
+    // the txs it confirms leave the mempool, or we would mine them again
+    if (!pending_.empty()) {
+      std::unordered_set<std::string> ids;
+      for (const auto& tx : b.getTransactions()) ids.insert(tx.getId());
+      pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+                                    [&ids](const Transaction& t) { return ids.count(t.getId()) != 0; }),
+                     pending_.end());
+      m.mempool.set(static_cast<double>(pending_.size()));
+    }
+    m.blk_peer.inc();
+    m.blk_txs.record(b.getTransactions().size());
+    m.height.set(static_cast<double>(height()));
+    snap = snapshotDue();
+    prune();
+  }
+  if (snap) publishSnapshot(std::move(snap));
+  notifyBlock(b);
+  return true;
+}
+
+std::string Blockchain::deployContract(const std::vector<Instr>& code, std::string* err) {
+  auto prog = Program::verify(code, err);
+  if (!prog) return "";
+  std::string addr = "QTC" + Hash::sha256Hex(Program::encode(code)).substr(0, 40);
+  std::lock_guard<std::mutex> lk(vm_mu_);
+  // identical code maps to the same contract and keeps its storage
+  if (!contracts_.count(addr)) contracts_[addr] = std::shared_ptr<const Program>(std::move(prog));
+  return addr;
+}
+
+bool Blockchain::callContract(const std::string& address, const std::vector<uint64_t>& args, uint64_t gasLimit,
+                              VM::Result& out) {
+  std::lock_guard<std::mutex> lk(vm_mu_);
+  auto it = contracts_.find(address);
+  if (it == contracts_.end()) return false;
+  BufferedStorage st(storage_[address]);
+  out = VM::run(*it->second, st, std::min(gasLimit, MAX_CALL_GAS), args.data(), args.size());
+  if (out.status == VM::Status::Ok) st.commit();
   return true;
 }
 
+uint64_t Blockchain::getStorage(const std::string& address, uint64_t key) const {
+  std::lock_guard<std::mutex> lk(vm_mu_);
+  auto c = storage_.find(address);
+  if (c == storage_.end()) return 0;
+  auto it = c->second.find(key);
+  return it != c->second.end() ? it->second : 0;
+}
+
+std::unique_ptr<Blockchain::SnapshotSource> Blockchain::snapshotDue() const {
+  if (snapshot_interval_ == 0 || height() % snapshot_interval_ != 0) return nullptr;
+  return std::unique_ptr<SnapshotSource>(new SnapshotSource{*chain_.back(), balances_, minted_});
+}
+
+void Blockchain::publishSnapshot(std::unique_ptr<SnapshotSource> src) {
+  std::shared_ptr<const Snapshot> s = Snapshot::build(src->tip, src->balances, src->minted);
+  std::lock_guard<std::mutex> lk(snap_mu_);
+  if (!snapshot_ || snapshot_->height < s->height) snapshot_ = std::move(s);
+}
+
+void Blockchain::setSnapshotInterval(uint64_t blocks) {
+  std::lock_guard<std::mutex> lk(mu_);
+  snapshot_interval_ = blocks;
+}
+
+std::shared_ptr<const Snapshot> Blockchain::latestSnapshot() const {
+  std::lock_guard<std::mutex> lk(snap_mu_);
+  return snapshot_;
+}
+
+bool Blockchain::installSnapshot(const Snapshot& s, std::map<std::string, uint64_t> balances) {
+  std::unique_ptr<SnapshotSource> src;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    // only a node that has nothing beyond genesis replaces its state
+    if (!s.tip || height() != 1 || s.height <= 1 || s.tip->getDifficulty() != difficulty_) return false;
+    chain_.clear();
+    chain_.emplace_back(new Block(*s.tip));
+    base_ = s.height - 1;
+    headers_.clear();
+    hdr_base_ = base_;
+    balances_ = std::move(balances);
+    minted_ = s.minted;
+    pending_.clear();
+    auto& m = chain_metrics();
+    m.height.set(static_cast<double>(height()));
+    m.base.set(static_cast<double>(base_));
+    m.mempool.set(0);
+    src.reset(new SnapshotSource{*s.tip, balances_, minted_});
+  }
+  // serve the installed state to the next joiner as well
+  publishSnapshot(std::move(src));
+  return true;
+}
+
+uint64_t Blockchain::getBaseHeight() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return base_;
+}
+
+void Blockchain::setPruneDepth(uint64_t blocks) {
+  std::lock_guard<std::mutex> lk(mu_);
+  prune_keep_ = blocks;
+  prune();
+}
+
+bool Blockchain::isPruned() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return prune_keep_ != 0;
+}
+
+// mu_ held. Drops the oldest bodies beyond the prune depth, keeping their
+// headers; the tip body always stays.
+void Blockchain::prune() {
+  if (prune_keep_ == 0 || height() <= prune_keep_) return;
+  uint64_t keep_from = height() - prune_keep_;
+  if (snapshot_interval_) {
+    auto s = latestSnapshot();
+    keep_from = std::min(keep_from, s ? s->height : 0);
+  }
+  while (base_ < keep_from && chain_.size() > 1) {
+    headers_.push_back(chain_.front()->header());
+    chain_.pop_front();
+    ++base_;
+  }
+  chain_metrics().base.set(static_cast<double>(base_));
+}
+
 void Blockchain::setP2P(P2P* p) { p2p_ = p; }
 P2P* Blockchain::p2p() const { return p2p_; }
 
+void Blockchain::addBlockListener(BlockListener l) {
+  std::lock_guard<std::mutex> lk(listen_mu_);
+  block_listeners_.push_back(std::move(l));
+}
+
+void Blockchain::addTxListener(TxListener l) {
+  std::lock_guard<std::mutex> lk(listen_mu_);
+  tx_listeners_.push_back(std::move(l));
+}
+
+void Blockchain::notifyBlock(const Block& b) {
+  std::vector<BlockListener> ls;
+  { std::lock_guard<std::mutex> lk(listen_mu_); ls = block_listeners_; }
+  for (auto& l : ls) l(b);
+}
+
+void Blockchain::notifyTx(const Transaction& tx) {
+  std::vector<TxListener> ls;
+  { std::lock_guard<std::mutex> lk(listen_mu_); ls = tx_listeners_; }
+  for (auto& l : ls) l(tx);
+}
+
 }
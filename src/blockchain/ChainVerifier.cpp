@@ -0,0 +1,177 @@
+// src/blockchain/ChainVerifier.cpp
+#include "blockchain/ChainVerifier.h"
+#include "blockchain/Block.h"
+#include "blockchain/Blockchain.h"
+#include "blockchain/Transaction.h"
+#include "crypto/Hash.h"
+#include "crypto/Signature.h"
+#include "utils/Metrics.h"
+#include "utils/ThreadPool.h"
+#include "zk/Zk.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace QTC {
+
+namespace {
+struct VerifyMetrics {
+  Counter& ok = Metrics::instance().counter("qtc_chain_verify_runs_total", "Chain verification runs", Metrics::label("result", "ok"));
+  Counter& failed = Metrics::instance().counter("qtc_chain_verify_runs_total", "Chain verification runs", Metrics::label("result", "failed"));
+  Counter& blocks = Metrics::instance().counter("qtc_chain_verify_blocks_total", "Blocks re-checked by chain verification");
+  Gauge& rate = Metrics::instance().gauge("qtc_chain_verify_blocks_per_second", "Throughput of the last verification run");
+};
+VerifyMetrics& verify_metrics() { static VerifyMetrics m; return m; }
+
+// not verifier_pool(): the zk batch check below blocks on that pool, which
+// would deadlock if its own workers were the ones waiting
+ThreadPool& window_pool() {
+  static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+  return pool;
+}
+
+constexpr const char* kBadDifficulty = "difficulty is not the chain's";
+
+// Checks that need only the block itself; nullptr if it passes. Links
+// between blocks are checked serially by the caller.
+const char* check_body(const Block& b, bool full, uint32_t difficulty) {
+  if (b.getDifficulty() != difficulty) return kBadDifficulty;
+  const auto& txs = b.getTransactions();
+  for (const auto& tx : txs)
+    if (!tx.hasValidId()) return "txid does not match transaction";
+  if (!b.hasValidMerkle()) return "merkle root mismatch";
+  if (!full) return nullptr;
+  if (!b.header().hasValidHash()) return "bad header hash or proof of work";
+  std::vector<std::string> proofs;
+  for (const auto& tx : txs) {
+    if (!tx.getProof().empty()) proofs.push_back(tx.getProof());
+    if (tx.getFrom() == "COINBASE") continue;
+    // plain verify: a re-check must not be answered from the verified cache
+    if (tx.getSignature().empty() || Signature::address(tx.getPubKey()) != tx.getFrom() ||
+        !Signature::verify(tx.getPubKey(), tx.getId(), tx.getSignature()))
+      return "invalid signature";
+  }
+  if (!proofs.empty() && !Zk::verify_transfer_batch(proofs)) return "invalid zk proof";
+  return nullptr;
+}
+}
+
+ChainVerifier::Result ChainVerifier::run(const Blockchain& chain, const Options& o) {
+  using Clock = std::chrono::steady_clock;
+  Result r;
+  auto t0 = Clock::now();
+  uint64_t count = chain.getBlockCount();
+  uint64_t to = std::min(o.to, count - 1);
+  if (count == 0 || o.from > to) { r.error = "empty range"; return r; }
+
+  bool checkpoint = false;
+  uint64_t avHeight = 0;
+  if (!o.assumeValid.empty()) {
+    if (!chain.findHeight(o.assumeValid, avHeight)) { r.error = "assume-valid block not in chain"; return r; }
+    checkpoint = true;
+  }
+
+  // every block is mined at the chain's difficulty; a block's own diff
+  // field only says how much work its hash claims
+  const uint32_t difficulty = chain.getDifficulty();
+
+  ThreadPool* pool = o.parallel && std::thread::hardware_concurrency() > 1 ? &window_pool() : nullptr;
+
+  std::vector<BlockHeader> headers;
+  std::vector<std::unique_ptr<Block>> bodies;
+  std::vector<const char*> bad;
+  std::string prevHash; // hash of the block before the window, "" if not held
+  uint64_t h = o.from;
+  bool first = true;
+  if (h > 0 && chain.copyRange(h - 1, 1, headers, bodies) == h - 1) {
+    if (!headers.empty()) prevHash = Hash::toHex(headers[0].hash);
+    else if (!bodies.empty()) prevHash = bodies[0]->getHash();
+  }
+  auto fail = [&r](uint64_t height, const char* why) {
+    r.badHeight = static_cast<int64_t>(height);
+    r.error = why;
+  };
+
+  while (h <= to) {
+    size_t want = static_cast<size_t>(std::min<uint64_t>(kWindow, to - h + 1));
+    uint64_t start = chain.copyRange(h, want, headers, bodies);
+    if (first) {
+      r.from = start;
+      first = false;
+    } else if (start != h) {
+      fail(h, "block no longer held");
+      break;
+    }
+    size_t nh = headers.size(), n = nh + bodies.size();
+    if (n == 0) break;
+    if (start > to) break;
+    n = std::min<size_t>(n, static_cast<size_t>(to - start + 1));
+
+    // parallel part: everything that depends on one block only
+    bad.assign(n, nullptr);
+    auto one = [&](size_t i) {
+      uint64_t height = start + i;
+      bool full = !checkpoint || height > avHeight;
+      if (i < nh) {
+        if (headers[i].diff != difficulty) bad[i] = kBadDifficulty;
+        else if (full && !headers[i].hasValidHash()) bad[i] = "bad header hash or proof of work";
+      } else {
+        bad[i] = check_body(*bodies[i - nh], full, difficulty);
+      }
+    };
+    if (pool) pool->parallelFor(n, 4, one);
+    else for (size_t i = 0; i < n; ++i) one(i);
+
+    // serial part: indices and links, then the first failure in height order
+    for (size_t i = 0; i < n && r.badHeight < 0; ++i) {
+      uint64_t height = start + i;
+      uint64_t index;
+      std::string prev, hash;
+      if (i < nh) {
+        index = headers[i].index;
+        prev = headers[i].prevHex();
+        hash = Hash::toHex(headers[i].hash);
+      } else {
+        const Block& b = *bodies[i - nh];
+        index = b.getIndex();
+        prev = b.getPrev();
+        hash = b.getHash();
+      }
+      if (index != height) fail(height, "index does not match height");
+      else if (height == 0 && prev != "0") fail(height, "genesis has a parent");
+      // the oldest held block's parent is not held (snapshot sync)
+      else if (!prevHash.empty() && prev != prevHash) fail(height, "prev hash does not link");
+      else if (bad[i]) fail(height, bad[i]);
+      else {
+        ++r.checked;
+        if (i < nh) ++r.headersOnly;
+        if (checkpoint && height <= avHeight) ++r.assumed;
+      }
+      prevHash = hash;
+    }
+    r.to = start + n - 1;
+    if (r.badHeight >= 0) break;
+    h = start + n;
+
+    double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    if (o.progress &&
+        !o.progress(Progress{r.to, r.checked, to - r.from + 1, secs > 0 ? r.checked / secs : 0})) {
+      r.error = "cancelled";
+      break;
+    }
+  }
+
+  r.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+  r.blocksPerSec = r.seconds > 0 ? r.checked / r.seconds : 0;
+  r.ok = r.badHeight < 0 && r.error.empty() && r.checked > 0;
+  if (r.checked == 0 && r.error.empty()) r.error = "no blocks held in range";
+  auto& m = verify_metrics();
+  (r.ok ? m.ok : m.failed).inc();
+  m.blocks.inc(r.checked);
+  m.rate.set(r.blocksPerSec);
+  return r;
+}
+
+}
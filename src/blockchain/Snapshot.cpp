@@ -0,0 +1,102 @@
+// src/blockchain/Snapshot.cpp
+#include "blockchain/Snapshot.h"
+#include "blockchain/Transaction.h"
+#include "config/Constants.h"
+#include "crypto/Hash.h"
+
+using pt = boost::property_tree::ptree;
+
+namespace QTC {
+
+// chunk body: one "<len>:<address><balance>\n" record per account, so any
+// address bytes round-trip unambiguously
+std::shared_ptr<Snapshot> Snapshot::build(const Block& tip, const std::map<std::string, uint64_t>& balances,
+                                          uint64_t minted) {
+  auto s = std::make_shared<Snapshot>();
+  s->height = static_cast<uint64_t>(tip.getIndex()) + 1;
+  s->tip.reset(new Block(tip));
+  s->minted = minted;
+  std::string cur;
+  size_t n = 0;
+  for (const auto& kv : balances) {
+    cur += std::to_string(kv.first.size());
+    cur += ':';
+    cur += kv.first;
+    cur += std::to_string(kv.second);
+    cur += '\n';
+    if (++n == SNAPSHOT_CHUNK_ACCOUNTS) { s->chunks.push_back(std::move(cur)); cur.clear(); n = 0; }
+  }
+  if (n || s->chunks.empty()) s->chunks.push_back(std::move(cur));
+  for (auto& d : Hash::sha256Batch(s->chunks)) s->chunkHashes.push_back(Hash::toHex(d));
+  s->root = computeRoot(s->height, tip.getHash(), minted, s->chunkHashes);
+  return s;
+}
+
+std::string Snapshot::computeRoot(uint64_t height, const std::string& tipHash, uint64_t minted,
+                                  const std::vector<std::string>& chunkHashes) {
+  std::string in = std::to_string(height) + "|" + tipHash + "|" + std::to_string(minted) + "|";
+  for (const auto& h : chunkHashes) in += h;
+  return Hash::sha256Hex(in);
+}
+
+pt Snapshot::manifest() const {
+  pt m;
+  m.put("height", static_cast<unsigned long long>(height));
+  m.put("minted", static_cast<unsigned long long>(minted));
+  m.put("root", root);
+  m.add_child("tip", tip->toPtree());
+  pt arr;
+  for (const auto& h : chunkHashes) { pt v; v.put("", h); arr.push_back(std::make_pair("", v)); }
+  m.add_child("chunks", arr);
+  return m;
+}
+
+std::shared_ptr<Snapshot> Snapshot::fromManifest(const pt& m, uint32_t difficulty) {
+  auto s = std::make_shared<Snapshot>();
+  s->height = m.get<uint64_t>("height", 0);
+  s->minted = m.get<uint64_t>("minted", 0);
+  s->root = m.get<std::string>("root", "");
+  auto tip = m.get_child_optional("tip");
+  auto arr = m.get_child_optional("chunks");
+  if (!tip || !arr || s->height == 0) return nullptr;
+  s->tip = Block::fromPtree(*tip);
+  if (!s->tip || s->tip->getIndex() + 1 != s->height || s->tip->getDifficulty() != difficulty ||
+      !s->tip->hasValidHash())
+    return nullptr;
+  for (const auto& v : *arr) s->chunkHashes.push_back(v.second.get_value<std::string>());
+  if (s->chunkHashes.empty()) return nullptr;
+  if (computeRoot(s->height, s->tip->getHash(), s->minted, s->chunkHashes) != s->root) return nullptr;
+  return s;
+}
+
+bool Snapshot::checkChunk(size_t i, const std::string& data) const {
+  return i < chunkHashes.size() && Hash::sha256Hex(data) == chunkHashes[i];
+}
+
+bool Snapshot::parseChunk(const std::string& data, std::map<std::string, uint64_t>& out) {
+  size_t p = 0;
+  auto number = [&data, &p](char end, uint64_t& v) {
+    size_t start = p;
+    v = 0;
+    while (p < data.size() && data[p] >= '0' && data[p] <= '9') {
+      uint64_t d = static_cast<uint64_t>(data[p] - '0');
+      if (v > (UINT64_MAX - d) / 10) return false;
+      v = v * 10 + d;
+      ++p;
+    }
+    if (p == start || p >= data.size() || data[p] != end) return false;
+    ++p;
+    return true;
+  };
+  while (p < data.size()) {
+    uint64_t len = 0, bal = 0;
+    if (!number(':', len) || len > data.size() - p) return false;
+    std::string addr = data.substr(p, static_cast<size_t>(len));
+    p += static_cast<size_t>(len);
+    if (!number('\n', bal)) return false;
+    out[addr] = bal;
+  }
+  return true;
+}
+
+}
@@ -1,39 +1,52 @@
 #include "blockchain/Transaction.h"
-#include <openssl/sha.h>
-#include <sstream>
-#include <iomanip>
+#include "crypto/Hash.h"
+#include "crypto/Signature.h"
 #include <ctime>
 
 using pt = boost::property_tree::ptree;
 
 namespace QTC {
 
-static std::string sha256(const std::string& s) {
-  unsigned char h[SHA256_DIGEST_LENGTH];
-  SHA256(reinterpret_cast<const unsigned char*>(s.data()), s.size(), h);
-  std::ostringstream o;
-  for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i)
-    o << std::hex << std::setw(2) << std::setfill('0') << (int)h[i];
-  return o.str();
-}
-
-Transaction::Transaction(const std::string& from, const std::string& to, uint64_t amount, uint64_t fee)
-  : from_(from), to_(to), amount_(amount), fee_(fee) {
+Transaction::Transaction(const std::string& from, const std::string& to, uint64_t amount, uint64_t fee,
+                         const std::string& proof)
+  : from_(from), to_(to), amount_(amount), fee_(fee), proof_(proof) {
   ts_ = static_cast<uint64_t>(std::time(nullptr));
   computeId();
 }
 
-void Transaction::computeId() {
-  std::ostringstream s; s << from_ << to_ << amount_ << fee_ << ts_;
-  id_ = sha256(s.str());
+std::string Transaction::calcId() const {
+  std::string s = from_ + to_ + std::to_string(amount_) + std::to_string(fee_) + std::to_string(ts_);
+  // only shielded transfers commit to a proof, plain tx ids are unchanged
+  if (!proof_.empty()) s += proof_;
+  return Hash::sha256Hex(s);
 }
 
+void Transaction::computeId() { id_ = calcId(); }
+
+bool Transaction::hasValidId() const { return calcId() == id_; }
+
 const std::string& Transaction::getId() const { return id_; }
 const std::string& Transaction::getFrom() const { return from_; }
 const std::string& Transaction::getTo() const { return to_; }
 uint64_t Transaction::getAmount() const { return amount_; }
 uint64_t Transaction::getFee() const { return fee_; }
 uint64_t Transaction::getTimestamp() const { return ts_; }
+const std::string& Transaction::getProof() const { return proof_; }
+const std::string& Transaction::getPubKey() const { return pubkey_; }
+const std::string& Transaction::getSignature() const { return sig_; }
+
+// the txid already commits to every other field, so it is what gets signed;
+// pubkey and signature stay out of the id
+void Transaction::sign(const std::string& privKey, const std::string& pubKey) {
+  pubkey_ = pubKey;
+  sig_ = Signature::sign(privKey, id_);
+}
+
+bool Transaction::verifySignature() const {
+  if (pubkey_.empty() || sig_.empty()) return false;
+  if (Signature::address(pubkey_) != from_) return false;
+  return Signature::verifyCached(pubkey_, id_, sig_);
+}
 
 pt Transaction::toPtree() const {
   pt t;
@@ -43,6 +56,8 @@ pt Transaction::toPtree() const {
   t.put("amount", static_cast<unsigned long long>(amount_));
   t.put("fee", static_cast<unsigned long long>(fee_));
   t.put("timestamp", static_cast<unsigned long long>(ts_));
+  if (!proof_.empty()) t.put("proof", proof_);
+  if (!sig_.empty()) { t.put("pubkey", pubkey_); t.put("sig", sig_); }
   return t;
 }
 
@@ -52,9 +67,15 @@ std::unique_ptr<Transaction> Transaction::fromPtree(const pt& t) {
   uint64_t amount = t.get<uint64_t>("amount", 0);
   uint64_t fee = t.get<uint64_t>("fee", 0);
   uint64_t ts = t.get<uint64_t>("timestamp", 0);
-  auto tx = std::unique_ptr<Transaction>(new Transaction(from, to, amount, fee));
+  std::string proof = t.get<std::string>("proof", "");
+  auto tx = std::unique_ptr<Transaction>(new Transaction(from, to, amount, fee, proof));
   tx->ts_ = ts ? ts : tx->ts_;
   tx->computeId();
+  // keep the id as sent, so hasValidId() can catch one that does not match
+  std::string id = t.get<std::string>("id", "");
+  if (!id.empty()) tx->id_ = id;
+  tx->pubkey_ = t.get<std::string>("pubkey", "");
+  tx->sig_ = t.get<std::string>("sig", "");
   return tx;
 }
 
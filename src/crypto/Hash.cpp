@@ -0,0 +1,381 @@
+// src/crypto/Hash.cpp
+#include "crypto/Hash.h"
+#include <openssl/sha.h>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define QTC_HASH_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace QTC {
+
+namespace {
+
+const uint32_t kInit[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+alignas(16) const uint32_t kRound[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t load_be32(const uint8_t* p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+  p[0] = uint8_t(v >> 24); p[1] = uint8_t(v >> 16); p[2] = uint8_t(v >> 8); p[3] = uint8_t(v);
+}
+
+// Final 1-2 blocks of a message: the bytes after the last full block, the
+// 0x80 terminator, zero fill and the big-endian bit length. Returns blocks used.
+size_t pad_tail(const uint8_t* data, size_t len, uint8_t tail[128]) {
+  size_t rem = len % 64;
+  std::memset(tail, 0, 128);
+  if (rem) std::memcpy(tail, data + (len - rem), rem);
+  tail[rem] = 0x80;
+  size_t blocks = rem + 9 > 64 ? 2 : 1;
+  uint64_t bits = static_cast<uint64_t>(len) * 8;
+  for (int i = 0; i < 8; ++i) tail[blocks * 64 - 1 - i] = uint8_t(bits >> (8 * i));
+  return blocks;
+}
+
+Hash::Digest sha256_portable(const void* data, size_t len) {
+  Hash::Digest d;
+  SHA256(static_cast<const unsigned char*>(data), len, d.data());
+  return d;
+}
+
+#ifdef QTC_HASH_X86
+
+// ---- SHA-NI: one message, two rounds per sha256rnds2 ----
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void compress_shani(uint32_t state[8], const uint8_t* data, size_t blocks) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+  __m128i st1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);           // CDAB
+  st1 = _mm_shuffle_epi32(st1, 0x1B);           // EFGH
+  __m128i st0 = _mm_alignr_epi8(tmp, st1, 8);   // ABEF
+  st1 = _mm_blend_epi16(st1, tmp, 0xF0);        // CDGH
+
+  while (blocks--) {
+    const __m128i abef = st0, cdgh = st1;
+    __m128i w[4];
+#pragma GCC unroll 16
+    for (int g = 0; g < 16; ++g) {
+      if (g < 4) w[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * g)), mask);
+      __m128i msg = _mm_add_epi32(w[g & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(&kRound[4 * g])));
+      st1 = _mm_sha256rnds2_epu32(st1, st0, msg);
+      if (g >= 3 && g < 15) {
+        __m128i t = _mm_alignr_epi8(w[g & 3], w[(g + 3) & 3], 4);
+        w[(g + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(g + 1) & 3], t), w[g & 3]);
+      }
+      msg = _mm_shuffle_epi32(msg, 0x0E);
+      st0 = _mm_sha256rnds2_epu32(st0, st1, msg);
+      if (g >= 1 && g < 13) w[(g + 3) & 3] = _mm_sha256msg1_epu32(w[(g + 3) & 3], w[g & 3]);
+    }
+    st0 = _mm_add_epi32(st0, abef);
+    st1 = _mm_add_epi32(st1, cdgh);
+    data += 64;
+  }
+
+  tmp = _mm_shuffle_epi32(st0, 0x1B);           // FEBA
+  st1 = _mm_shuffle_epi32(st1, 0xB1);           // DCHG
+  st0 = _mm_blend_epi16(tmp, st1, 0xF0);        // DCBA
+  st1 = _mm_alignr_epi8(st1, tmp, 8);           // ABEF
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), st0);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), st1);
+}
+
+Hash::Digest sha256_shani(const void* data, size_t len) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint32_t st[8];
+  std::memcpy(st, kInit, sizeof(st));
+  compress_shani(st, p, len / 64);
+  uint8_t tail[128];
+  compress_shani(st, tail, pad_tail(p, len, tail));
+  Hash::Digest d;
+  for (int i = 0; i < 8; ++i) store_be32(d.data() + 4 * i, st[i]);
+  return d;
+}
+
+// ---- AVX2: eight independent messages, one per 32-bit lane ----
+
+#define QTC_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+#define QTC_XOR3(a, b, c) _mm256_xor_si256(_mm256_xor_si256((a), (b)), (c))
+
+__attribute__((target("avx2")))
+void sha256_avx2_x8(const Hash::Span* in, Hash::Digest* out, size_t n) {
+  static const uint8_t zero[64] = {0};
+  uint8_t tail[8][128];
+  const uint8_t* msg[8];
+  size_t full[8], nblocks[8], maxb = 0;
+  for (size_t l = 0; l < 8; ++l) {
+    if (l < n) {
+      msg[l] = static_cast<const uint8_t*>(in[l].data);
+      full[l] = in[l].len / 64;
+      nblocks[l] = full[l] + pad_tail(msg[l], in[l].len, tail[l]);
+    } else {
+      msg[l] = zero; full[l] = 0; nblocks[l] = 0;
+    }
+    if (nblocks[l] > maxb) maxb = nblocks[l];
+  }
+
+  __m256i s[8];
+  for (int i = 0; i < 8; ++i) s[i] = _mm256_set1_epi32(static_cast<int>(kInit[i]));
+
+  for (size_t b = 0; b < maxb; ++b) {
+    const uint8_t* blk[8];
+    alignas(32) int32_t live[8];
+    for (size_t l = 0; l < 8; ++l) {
+      if (b < full[l]) blk[l] = msg[l] + 64 * b;
+      else if (b < nblocks[l]) blk[l] = tail[l] + 64 * (b - full[l]);
+      else blk[l] = zero;
+      live[l] = b < nblocks[l] ? -1 : 0;
+    }
+
+    __m256i w[16];
+    for (int t = 0; t < 16; ++t) {
+      w[t] = _mm256_setr_epi32(
+        static_cast<int>(load_be32(blk[0] + 4 * t)), static_cast<int>(load_be32(blk[1] + 4 * t)),
+        static_cast<int>(load_be32(blk[2] + 4 * t)), static_cast<int>(load_be32(blk[3] + 4 * t)),
+        static_cast<int>(load_be32(blk[4] + 4 * t)), static_cast<int>(load_be32(blk[5] + 4 * t)),
+        static_cast<int>(load_be32(blk[6] + 4 * t)), static_cast<int>(load_be32(blk[7] + 4 * t)));
+    }
+
+    __m256i a = s[0], bb = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int t = 0; t < 64; ++t) {
+      if (t >= 16) {
+        __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+        __m256i s0 = QTC_XOR3(QTC_ROTR(w15, 7), QTC_ROTR(w15, 18), _mm256_srli_epi32(w15, 3));
+        __m256i s1 = QTC_XOR3(QTC_ROTR(w2, 17), QTC_ROTR(w2, 19), _mm256_srli_epi32(w2, 10));
+        w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+      }
+      __m256i S1 = QTC_XOR3(QTC_ROTR(e, 6), QTC_ROTR(e, 11), QTC_ROTR(e, 25));
+      __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                     _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(kRound[t])), w[t & 15])));
+      __m256i S0 = QTC_XOR3(QTC_ROTR(a, 2), QTC_ROTR(a, 13), QTC_ROTR(a, 22));
+      __m256i maj = _mm256_or_si256(_mm256_and_si256(a, bb), _mm256_and_si256(c, _mm256_or_si256(a, bb)));
+      __m256i t2 = _mm256_add_epi32(S0, maj);
+      h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+      d = c; c = bb; bb = a; a = _mm256_add_epi32(t1, t2);
+    }
+
+    // lanes whose message already ended keep their final state
+    const __m256i keep = _mm256_load_si256(reinterpret_cast<const __m256i*>(live));
+    const __m256i nv[8] = { a, bb, c, d, e, f, g, h };
+    for (int i = 0; i < 8; ++i) s[i] = _mm256_blendv_epi8(s[i], _mm256_add_epi32(s[i], nv[i]), keep);
+  }
+
+  alignas(32) uint32_t lanes[8][8];
+  for (int i = 0; i < 8; ++i) _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[i]), s[i]);
+  for (size_t l = 0; l < n; ++l)
+    for (int i = 0; i < 8; ++i) store_be32(out[l].data() + 4 * i, lanes[i][l]);
+}
+
+#undef QTC_XOR3
+#undef QTC_ROTR
+
+bool cpu_has_shani() {
+  unsigned a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+  bool ssse3 = c & (1u << 9), sse41 = c & (1u << 19);
+  if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+  return ssse3 && sse41 && (b & (1u << 29));
+}
+
+bool cpu_has_avx2() {
+  unsigned a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+  if (!(c & (1u << 27)) || !(c & (1u << 28))) return false; // OSXSAVE, AVX
+  unsigned lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  if ((lo & 6) != 6) return false; // OS saves XMM and YMM state
+  if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+  return b & (1u << 5);
+}
+
+#endif // QTC_HASH_X86
+
+Hash::Digest sha256_with(Hash::Impl i, const void* data, size_t len) {
+#ifdef QTC_HASH_X86
+  if (i == Hash::Impl::ShaNi) return sha256_shani(data, len);
+  if (i == Hash::Impl::Avx2) {
+    Hash::Span sp{data, len};
+    Hash::Digest d;
+    sha256_avx2_x8(&sp, &d, 1);
+    return d;
+  }
+#endif
+  (void)i;
+  return sha256_portable(data, len);
+}
+
+void batch_with(Hash::Impl i, const Hash::Span* in, Hash::Digest* out, size_t n) {
+#ifdef QTC_HASH_X86
+  if (i == Hash::Impl::Avx2) {
+    for (size_t k = 0; k < n; k += 8) sha256_avx2_x8(in + k, out + k, n - k < 8 ? n - k : 8);
+    return;
+  }
+#endif
+  for (size_t k = 0; k < n; ++k) out[k] = sha256_with(i, in[k].data, in[k].len);
+}
+
+// Known answers from the portable backend over lengths that cover one and
+// two padding blocks and multi-block messages; a backend that disagrees is
+// never enabled.
+bool self_test(Hash::Impl i) {
+  uint8_t buf[300];
+  for (size_t k = 0; k < sizeof(buf); ++k) buf[k] = uint8_t(k * 7 + 3);
+  const size_t lens[] = { 0, 3, 55, 56, 63, 64, 65, 119, 120, 128, 200, 300 };
+  Hash::Span sp[12];
+  Hash::Digest got[12];
+  for (size_t k = 0; k < 12; ++k) sp[k] = Hash::Span{buf, lens[k]};
+  batch_with(i, sp, got, 12);
+  for (size_t k = 0; k < 12; ++k) {
+    auto want = sha256_portable(buf, lens[k]);
+    if (got[k] != want || sha256_with(i, buf, lens[k]) != want) return false;
+  }
+  return true;
+}
+
+struct Backends {
+  bool has[3]{true, false, false};
+  std::atomic<Hash::Impl> single{Hash::Impl::Portable};
+  std::atomic<Hash::Impl> batch{Hash::Impl::Portable};
+  Hash::Impl def_single{Hash::Impl::Portable}, def_batch{Hash::Impl::Portable};
+
+  Backends() {
+#ifdef QTC_HASH_X86
+    has[static_cast<int>(Hash::Impl::ShaNi)] = cpu_has_shani() && self_test(Hash::Impl::ShaNi);
+    has[static_cast<int>(Hash::Impl::Avx2)] = cpu_has_avx2() && self_test(Hash::Impl::Avx2);
+#endif
+    // SHA-NI beats 8 software lanes per message, so it wins both paths when
+    // present; AVX2 lanes only pay off for batches
+    if (has[static_cast<int>(Hash::Impl::ShaNi)]) {
+      def_single = def_batch = Hash::Impl::ShaNi;
+    } else if (has[static_cast<int>(Hash::Impl::Avx2)]) {
+      def_batch = Hash::Impl::Avx2;
+    }
+    single = def_single;
+    batch = def_batch;
+  }
+};
+
+Backends& backends() {
+  static Backends b;
+  return b;
+}
+
+struct HexTable {
+  char pairs[256][2];
+  HexTable() {
+    const char* d = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) { pairs[i][0] = d[i >> 4]; pairs[i][1] = d[i & 15]; }
+  }
+};
+
+const HexTable& hex_table() {
+  static const HexTable t;
+  return t;
+}
+
+}
+
+Hash::Digest Hash::sha256(const void* data, size_t len) {
+  return sha256_with(backends().single.load(std::memory_order_relaxed), data, len);
+}
+
+void Hash::sha256Batch(const Span* in, Digest* out, size_t n) {
+  batch_with(backends().batch.load(std::memory_order_relaxed), in, out, n);
+}
+
+std::vector<Hash::Digest> Hash::sha256Batch(const std::vector<std::string>& msgs) {
+  std::vector<Span> in(msgs.size());
+  for (size_t i = 0; i < msgs.size(); ++i) in[i] = Span{msgs[i].data(), msgs[i].size()};
+  std::vector<Digest> out(msgs.size());
+  sha256Batch(in.data(), out.data(), in.size());
+  return out;
+}
+
+std::string Hash::toHex(const uint8_t* data, size_t len) {
+  const HexTable& hex = hex_table();
+  std::string s(len * 2, '\0');
+  char* o = &s[0];
+  for (size_t i = 0; i < len; ++i) { o[2 * i] = hex.pairs[data[i]][0]; o[2 * i + 1] = hex.pairs[data[i]][1]; }
+  return s;
+}
+
+bool Hash::fromHex(const std::string& hex, uint8_t* out, size_t n) {
+  if (hex.size() != 2 * n) return false;
+  auto nib = [](char c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  for (size_t i = 0; i < n; ++i) {
+    int a = nib(hex[2 * i]), b = nib(hex[2 * i + 1]);
+    if (a < 0 || b < 0) return false;
+    out[i] = static_cast<uint8_t>((a << 4) | b);
+  }
+  return true;
+}
+
+bool Hash::fromHex(const std::string& hex, std::string& out) {
+  if (hex.size() % 2) return false;
+  out.resize(hex.size() / 2);
+  return fromHex(hex, reinterpret_cast<uint8_t*>(&out[0]), out.size());
+}
+
+uint32_t Hash::leadingZeroNibbles(const Digest& d) {
+  uint32_t n = 0;
+  for (uint8_t b : d) {
+    if (b == 0) { n += 2; continue; }
+    if (b < 0x10) ++n;
+    break;
+  }
+  return n;
+}
+
+Hash::Impl Hash::single() { return backends().single.load(); }
+Hash::Impl Hash::batch() { return backends().batch.load(); }
+
+const char* Hash::name(Impl i) {
+  switch (i) {
+    case Impl::ShaNi: return "sha-ni";
+    case Impl::Avx2: return "avx2";
+    default: return "portable";
+  }
+}
+
+bool Hash::supported(Impl i) { return backends().has[static_cast<int>(i)]; }
+
+bool Hash::force(Impl i) {
+  auto& b = backends();
+  if (!b.has[static_cast<int>(i)]) return false;
+  b.single = i;
+  b.batch = i;
+  return true;
+}
+
+void Hash::reset() {
+  auto& b = backends();
+  b.single = b.def_single;
+  b.batch = b.def_batch;
+}
+
+}
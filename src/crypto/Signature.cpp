@@ -0,0 +1,116 @@
+// src/crypto/Signature.cpp
+#include "crypto/Signature.h"
+#include "crypto/Hash.h"
+#include "utils/VerifyCache.h"
+#include <openssl/evp.h>
+#include <memory>
+#include <unordered_map>
+
+namespace QTC {
+
+namespace {
+
+constexpr size_t kKeyLen = 32;
+constexpr size_t kSigLen = 64;
+
+struct PkeyFree { void operator()(EVP_PKEY* p) const { EVP_PKEY_free(p); } };
+struct MdCtxFree { void operator()(EVP_MD_CTX* c) const { EVP_MD_CTX_free(c); } };
+using Pkey = std::unique_ptr<EVP_PKEY, PkeyFree>;
+using MdCtx = std::unique_ptr<EVP_MD_CTX, MdCtxFree>;
+
+// Parsed public keys per thread. Importing a raw key costs about a third of
+// a verify and senders repeat across a block, so keep recent ones around.
+EVP_PKEY* public_key(const std::string& pub) {
+  thread_local std::unordered_map<std::string, Pkey> keys;
+  auto it = keys.find(pub);
+  if (it != keys.end()) return it->second.get();
+  unsigned char raw[kKeyLen];
+  if (!Hash::fromHex(pub, raw, kKeyLen)) return nullptr;
+  Pkey key(EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, raw, kKeyLen));
+  if (!key) return nullptr;
+  if (keys.size() >= 4096) keys.clear();
+  return keys.emplace(pub, std::move(key)).first->second.get();
+}
+
+std::string cache_key(const std::string& pub, const std::string& msg, const std::string& sig) {
+  std::string in;
+  in.reserve(pub.size() + msg.size() + sig.size() + 2);
+  in.append(pub).push_back('|');
+  in.append(msg).push_back('|');
+  in.append(sig);
+  return VerifyCache::key(in);
+}
+
+VerifyCache g_verified(200000);
+
+// signatures per verifier task; below two chunks the batch is checked inline
+constexpr size_t kVerifyChunk = 64;
+
+}
+
+Signature::KeyPair Signature::generate() {
+  KeyPair kp;
+  EVP_PKEY* raw = nullptr;
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+  if (ctx && EVP_PKEY_keygen_init(ctx) > 0) EVP_PKEY_keygen(ctx, &raw);
+  EVP_PKEY_CTX_free(ctx);
+  Pkey key(raw);
+  if (!key) return kp;
+  unsigned char priv[kKeyLen], pub[kKeyLen];
+  size_t pl = sizeof(priv), ul = sizeof(pub);
+  if (EVP_PKEY_get_raw_private_key(key.get(), priv, &pl) <= 0 ||
+      EVP_PKEY_get_raw_public_key(key.get(), pub, &ul) <= 0) return kp;
+  kp.priv = Hash::toHex(priv, pl);
+  kp.pub = Hash::toHex(pub, ul);
+  return kp;
+}
+
+std::string Signature::sign(const std::string& priv, const std::string& msg) {
+  unsigned char raw[kKeyLen];
+  if (!Hash::fromHex(priv, raw, kKeyLen)) return "";
+  Pkey key(EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, raw, kKeyLen));
+  MdCtx ctx(EVP_MD_CTX_new());
+  if (!key || !ctx) return "";
+  unsigned char sig[kSigLen];
+  size_t len = sizeof(sig);
+  if (EVP_DigestSignInit(ctx.get(), nullptr, nullptr, nullptr, key.get()) <= 0 ||
+      EVP_DigestSign(ctx.get(), sig, &len, reinterpret_cast<const unsigned char*>(msg.data()), msg.size()) <= 0)
+    return "";
+  return Hash::toHex(sig, len);
+}
+
+bool Signature::verify(const std::string& pub, const std::string& msg, const std::string& sig) {
+  thread_local MdCtx ctx(EVP_MD_CTX_new());
+  unsigned char rs[kSigLen];
+  if (!ctx || !Hash::fromHex(sig, rs, kSigLen)) return false;
+  EVP_PKEY* key = public_key(pub);
+  if (!key) return false;
+  EVP_MD_CTX_reset(ctx.get());
+  if (EVP_DigestVerifyInit(ctx.get(), nullptr, nullptr, nullptr, key) <= 0) return false;
+  return EVP_DigestVerify(ctx.get(), rs, kSigLen, reinterpret_cast<const unsigned char*>(msg.data()), msg.size()) == 1;
+}
+
+bool Signature::verifyCached(const std::string& pub, const std::string& msg, const std::string& sig) {
+  std::string k = cache_key(pub, msg, sig);
+  if (g_verified.contains(k)) return true;
+  if (!verify(pub, msg, sig)) return false;
+  g_verified.insert(k);
+  return true;
+}
+
+bool Signature::verifyBatch(const std::vector<Item>& items, size_t* bad) {
+  // signatures already checked at mempool admission are skipped
+  std::vector<std::string> keys(items.size());
+  for (size_t i = 0; i < items.size(); ++i) keys[i] = cache_key(*items[i].pub, *items[i].msg, *items[i].sig);
+  return g_verified.verifyBatch(keys, kVerifyChunk, [&items](size_t i) {
+    return verify(*items[i].pub, *items[i].msg, *items[i].sig);
+  }, bad);
+}
+
+std::string Signature::address(const std::string& pub) {
+  unsigned char raw[kKeyLen];
+  if (!Hash::fromHex(pub, raw, kKeyLen)) return "";
+  return "QTC" + Hash::toHex(Hash::sha256(raw, kKeyLen)).substr(0, 40);
+}
+
+}
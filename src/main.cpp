@@ -1,74 +1,200 @@
 #include "blockchain/Blockchain.h"
+#include "blockchain/ChainVerifier.h"
+#include "crypto/Hash.h"
 #include "wallet/Wallet.h"
 #include "network/Node.h"
+#include "rpc/EventBus.h"
 #include "rpc/RpcServer.h"
+#include "utils/Logger.h"
+#include "zk/Zk.h"
+#include <algorithm>
+#include <filesystem>
+#include <future>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <chrono>
+#include <vector>
+
+#ifndef QTC_VERSION
+#define QTC_VERSION "unknown"
+#endif
 
 using PT = QTC::RpcServer::PTree;
 
-int main(int, char**) {
+int main(int argc, char** argv) {
+  unsigned short p2pPort = 18444, rpcPort = 18443;
+  std::string dataDir = "qtc-data";
+  std::vector<std::string> connectTo;
+  uint64_t prune = 0;
+  std::string logFile;
+  std::vector<std::string> debugTags;
+  bool verifyAtStart = false;
+  std::string assumeValid;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    if (a == "--version") { std::cout << "qtc_node " << QTC_VERSION << "\n"; return 0; }
+    else if (a.rfind("--port=", 0) == 0) p2pPort = static_cast<unsigned short>(std::stoul(a.substr(7)));
+    else if (a.rfind("--rpcport=", 0) == 0) rpcPort = static_cast<unsigned short>(std::stoul(a.substr(10)));
+    else if (a.rfind("--connect=", 0) == 0) connectTo.push_back(a.substr(10));
+    else if (a.rfind("--datadir=", 0) == 0) dataDir = a.substr(10);
+    else if (a.rfind("--prune=", 0) == 0) prune = std::stoull(a.substr(8));
+    else if (a.rfind("--log=", 0) == 0) logFile = a.substr(6);
+    else if (a == "--verifychain") verifyAtStart = true;
+    else if (a.rfind("--assumevalid=", 0) == 0) assumeValid = a.substr(14);
+    else if (a.rfind("--debug=", 0) == 0) {
+      std::string list = a.substr(8);
+      for (size_t s = 0, e; s <= list.size(); s = e + 1) {
+        e = list.find(',', s);
+        if (e == std::string::npos) e = list.size();
+        if (e > s) debugTags.push_back(list.substr(s, e - s));
+      }
+    }
+    else {
+      std::cerr << "usage: qtc_node [--version] [--datadir=DIR] [--port=P2P_PORT] [--rpcport=RPC_PORT] [--connect=HOST:PORT]... [--prune=BLOCKS]\n"
+                   "                [--log=FILE] [--debug=TAG[,TAG]...|all] [--verifychain] [--assumevalid=BLOCKHASH]\n";
+      return 1;
+    }
+  }
+
+  auto& log = QTC::Logger::instance();
+  if (!logFile.empty() && !log.open(logFile)) { std::cerr << "cannot open log file " << logFile << "\n"; return 1; }
+  for (const auto& t : debugTags) {
+    QTC::LogTag tag;
+    if (t == "all") log.setLevel(QTC::LogLevel::Debug);
+    else if (QTC::Logger::parse(t, tag)) log.setLevel(tag, QTC::LogLevel::Debug);
+    else { std::cerr << "unknown log tag " << t << "\n"; return 1; }
+  }
+
+  std::error_code fsErr;
+  std::filesystem::create_directories(dataDir + "/zk", fsErr);
+  QTC::Zk::setup(dataDir + "/zk");
+
+  // declared first so they outlive the chain's listeners
+  QTC::EventBus events;
+  QTC::Wallet wallet;
+  if (!wallet.open(dataDir + "/wallet")) { std::cerr << "cannot load wallet in " << dataDir << "/wallet\n"; return 1; }
   QTC::Blockchain chain;
+  events.attach(chain);
+  wallet.attach(chain);
+  chain.setPruneDepth(prune);
+  if (verifyAtStart) {
+    QTC::ChainVerifier::Options vo;
+    vo.assumeValid = assumeValid;
+    auto last = std::chrono::steady_clock::now();
+    vo.progress = [&last](const QTC::ChainVerifier::Progress& p) {
+      auto now = std::chrono::steady_clock::now();
+      if (now - last < std::chrono::seconds(5)) return true;
+      last = now;
+      QTC_INFO(Chain, "verifying chain: %llu/%llu blocks, %.0f blocks/s", static_cast<unsigned long long>(p.done),
+               static_cast<unsigned long long>(p.total), p.blocksPerSec);
+      return true;
+    };
+    auto r = QTC::ChainVerifier::run(chain, vo);
+    if (!r.ok) {
+      QTC_ERROR(Chain, "chain verification failed at height %lld: %s", static_cast<long long>(r.badHeight),
+                r.error.c_str());
+      log.flush();
+      return 1;
+    }
+    QTC_INFO(Chain, "chain verified: %llu blocks (%llu assumed valid) in %.2fs, %.0f blocks/s",
+             static_cast<unsigned long long>(r.checked), static_cast<unsigned long long>(r.assumed), r.seconds,
+             r.blocksPerSec);
+  }
   QTC::P2P p2p(&chain);
   chain.setP2P(&p2p);
-  p2p.listen(18444);
+  p2p.listen(p2pPort);
+  for (const auto& hp : connectTo) {
+    auto c = hp.rfind(':');
+    if (c == std::string::npos) continue;
+    p2p.connect(hp.substr(0, c), static_cast<unsigned short>(std::stoul(hp.substr(c + 1))));
+  }
 
   QTC::RpcServer rpc;
 
   rpc.add("getblockcount", [&chain](const PT&) {
     PT r; r.put("", static_cast<unsigned long long>(chain.getBlockCount())); return r;
-  });
+  }, QTC::RpcServer::Cost::Cheap);
 
-  rpc.add("createaddress", [](const PT&) {
-    PT r; r.put("", QTC::Wallet::Create()); return r;
+  rpc.add("createaddress", [&wallet](const PT&) {
+    std::string addr = wallet.create();
+    if (addr.empty()) throw std::runtime_error("could not save a new wallet key");
+    PT r; r.put("", addr); return r;
   });
 
-  rpc.add("listaddresses", [](const PT&) {
+  rpc.add("listaddresses", [&wallet](const PT&) {
     PT arr; 
-    for (const auto& a : QTC::Wallet::All()) { 
+    for (const auto& a : wallet.addresses()) { 
       PT v; v.put("", a); 
       arr.push_back(std::make_pair("", v)); 
     } 
     return arr;
-  });
+  }, QTC::RpcServer::Cost::Cheap);
 
-  rpc.add("getbalance", [&chain](const PT& p) {
+  // getbalance() is the whole wallet; getbalance(address) any address
+  rpc.add("getbalance", [&chain, &wallet](const PT& p) {
     std::string a; 
     for (auto& v : p) { a = v.second.get_value<std::string>(); break; }
-    PT r; r.put("", static_cast<unsigned long long>(chain.getBalance(a))); 
+    uint64_t b = a.empty() ? wallet.balance() : wallet.owns(a) ? wallet.balance(a) : chain.getBalance(a);
+    PT r; r.put("", static_cast<unsigned long long>(b)); 
     return r;
-  });
+  }, QTC::RpcServer::Cost::Cheap);
 
-  rpc.add("sendtoaddress", [&chain](const PT& p) {
-    std::string to; uint64_t amount=0, fee=0;
+  // listtransactions([count]): the wallet's confirmed transfers, newest first
+  rpc.add("listtransactions", [&wallet](const PT& p) {
+    size_t count = 10;
+    for (auto& v : p) { count = v.second.get_value<size_t>(); break; }
+    PT arr;
+    for (const auto& tx : wallet.transactions(std::min<size_t>(count, QTC::Wallet::kMaxHistory))) {
+      PT t;
+      t.put("id", tx.id);
+      t.put("height", static_cast<unsigned long long>(tx.height));
+      t.put("from", tx.from);
+      t.put("to", tx.to);
+      t.put("amount", static_cast<unsigned long long>(tx.amount));
+      t.put("fee", static_cast<unsigned long long>(tx.fee));
+      arr.push_back(std::make_pair("", t));
+    }
+    return arr;
+  }, QTC::RpcServer::Cost::Cheap);
+
+  rpc.add("sendtoaddress", [&chain, &wallet](const PT& p) {
+    std::string to, proof; uint64_t amount=0, fee=0;
     int i=0; 
     for (auto& v : p) { 
       if(i==0) to=v.second.get_value<std::string>(); 
       if(i==1) amount=v.second.get_value<uint64_t>(); 
       if(i==2) fee=v.second.get_value<uint64_t>(); 
+      if(i==3) proof=v.second.get_value<std::string>(); 
       ++i; 
     }
     if (to.empty() || amount==0) { PT r; r.put("", ""); return r; }
-    std::string from = "QTC00000000000000000000000000000000000000";
-    QTC::Transaction tx(from, to, amount, fee);
-    chain.addTransaction(tx);
+    // spend from the first wallet address that can cover amount + fee
+    std::string from = wallet.spendable(amount + fee);
+    if (from.empty()) { PT r; r.put("", ""); return r; }
+    QTC::Transaction tx(from, to, amount, fee, proof);
+    if (!wallet.sign(tx)) throw std::runtime_error("could not sign with the key of " + from);
+    if (!chain.addTransaction(tx)) { PT r; r.put("", ""); return r; }
     PT r; r.put("", tx.getId()); 
     return r;
   });
 
-  rpc.add("generate", [&chain](const PT& p) {
+  rpc.add("generate", [&chain, &wallet](const PT& p) {
     std::string to; 
     for (auto& v : p) { to=v.second.get_value<std::string>(); break; }
     if (to.empty()) { 
-      const auto& all = QTC::Wallet::All(); 
+      const auto all = wallet.addresses(); 
       if (!all.empty()) to = all.front(); 
     }
     if (to.empty()) { PT r; r.put("", 0); return r; }
     chain.minePendingTransactions(to);
     PT r; r.put("", 1); 
     return r;
-  });
+  }, QTC::RpcServer::Cost::Heavy);
 
   // NEW: connect to a peer
   rpc.add("connectpeer", [&p2p](const PT& p) {
@@ -93,9 +219,176 @@ int main(int, char**) {
       arr.push_back(std::make_pair("", v)); 
     }
     return arr;
+  }, QTC::RpcServer::Cost::Cheap);
+
+  // zk proofs run on the prover pool: zkprove returns an operation id right
+  // away and zkresult polls it. Ids not polled to completion within ttl are
+  // forgotten, and at most max are held at once.
+  struct ZkOps {
+    const size_t max{1024};
+    const std::chrono::minutes ttl{10};
+    struct Op {
+      std::shared_future<std::string> result;
+      std::chrono::steady_clock::time_point started;
+    };
+    std::mutex mu;
+    uint64_t next{1};
+    std::map<std::string, Op> ops;
+  };
+  auto zkOps = std::make_shared<ZkOps>();
+
+  rpc.add("zkprove", [zkOps](const PT& p) {
+    std::string note;
+    for (auto& v : p) { note = v.second.get_value<std::string>(); break; }
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lk(zkOps->mu);
+    for (auto it = zkOps->ops.begin(); it != zkOps->ops.end();) {
+      if (now - it->second.started > zkOps->ttl) it = zkOps->ops.erase(it); else ++it;
+    }
+    if (zkOps->ops.size() >= zkOps->max) throw std::runtime_error("too many zk operations pending");
+    std::string id = "zkop-" + std::to_string(zkOps->next++);
+    zkOps->ops[id] = ZkOps::Op{QTC::Zk::prove_transfer_async(note).share(), now};
+    PT r; r.put("", id);
+    return r;
+  }, QTC::RpcServer::Cost::Heavy);
+
+  rpc.add("zkresult", [zkOps](const PT& p) {
+    std::string id;
+    for (auto& v : p) { id = v.second.get_value<std::string>(); break; }
+    PT r;
+    std::lock_guard<std::mutex> lk(zkOps->mu);
+    auto it = zkOps->ops.find(id);
+    if (it == zkOps->ops.end()) { r.put("status", "unknown"); return r; }
+    if (it->second.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) { r.put("status", "executing"); return r; }
+    std::string proof = it->second.result.get();
+    zkOps->ops.erase(it);
+    r.put("status", proof.empty() ? "failed" : "success");
+    r.put("proof", proof);
+    return r;
+  }, QTC::RpcServer::Cost::Cheap);
+
+  // contracts: bytecode is hex of 8-byte instructions (see vm/VM.h)
+  rpc.add("deploycontract", [&chain](const PT& p) {
+    std::string hex, bytes, err;
+    for (auto& v : p) { hex = v.second.get_value<std::string>(); break; }
+    std::vector<QTC::Instr> code;
+    PT r;
+    if (!QTC::Hash::fromHex(hex, bytes) || !QTC::Program::decode(bytes, code)) err = "malformed bytecode";
+    std::string addr = err.empty() ? chain.deployContract(code, &err) : "";
+    if (addr.empty()) { r.put("status", "invalid"); r.put("error", err); return r; }
+    r.put("status", "ok");
+    r.put("address", addr);
+    return r;
+  });
+
+  // callcontract(address, gas, args...): gas may not exceed MAX_CALL_GAS
+  // (config/Constants.h); calls hold the contract lock while they run
+  rpc.add("callcontract", [&chain](const PT& p) {
+    std::string addr; uint64_t gas = 0;
+    std::vector<uint64_t> args;
+    int i = 0;
+    for (auto& v : p) {
+      if (i == 0) addr = v.second.get_value<std::string>();
+      else if (i == 1) gas = v.second.get_value<uint64_t>();
+      else args.push_back(v.second.get_value<uint64_t>());
+      ++i;
+    }
+    if (gas > QTC::MAX_CALL_GAS)
+      throw std::invalid_argument("gas limit above " + std::to_string(QTC::MAX_CALL_GAS));
+    PT r;
+    QTC::VM::Result res{};
+    if (!chain.callContract(addr, args, gas, res)) { r.put("status", "unknown_contract"); return r; }
+    r.put("status", res.status == QTC::VM::Status::Ok ? "ok" : "out_of_gas");
+    r.put("result", static_cast<unsigned long long>(res.value));
+    r.put("gasUsed", static_cast<unsigned long long>(res.gasUsed));
+    return r;
+  });
+
+  rpc.add("getstorage", [&chain](const PT& p) {
+    std::string addr; uint64_t key = 0;
+    int i = 0;
+    for (auto& v : p) {
+      if (i == 0) addr = v.second.get_value<std::string>();
+      if (i == 1) key = v.second.get_value<uint64_t>();
+      ++i;
+    }
+    PT r; r.put("", static_cast<unsigned long long>(chain.getStorage(addr, key)));
+    return r;
+  }, QTC::RpcServer::Cost::Cheap);
+
+  // getblocks(from, count): NDJSON, one block per line, each copied out of
+  // the chain only when it is its turn to be written
+  rpc.addStream("getblocks", [&chain](const PT& p, const QTC::RpcServer::Emit& emit) {
+    uint64_t from = 0, count = 0;
+    int i = 0;
+    for (auto& v : p) {
+      if (i == 0) from = v.second.get_value<uint64_t>();
+      if (i == 1) count = v.second.get_value<uint64_t>();
+      ++i;
+    }
+    // blocks below the base height were pruned (or never downloaded)
+    uint64_t end = std::min(chain.getBlockCount(), from + std::min(count, UINT64_MAX - from));
+    for (uint64_t k = std::max(from, chain.getBaseHeight()); k < end; ++k) {
+      auto b = chain.getBlockCopyByIndex(k);
+      if (!b) continue;
+      if (!emit(b->toPtree())) break;
+    }
+  });
+
+  // verifychain([from], [to], [assumevalid]): NDJSON progress lines about
+  // once a second, then the result. The checkpoint defaults to --assumevalid;
+  // "" checks everything.
+  rpc.addStream("verifychain", [&chain, assumeValid](const PT& p, const QTC::RpcServer::Emit& emit) {
+    QTC::ChainVerifier::Options vo;
+    vo.assumeValid = assumeValid;
+    int i = 0;
+    for (auto& v : p) {
+      if (i == 0) vo.from = v.second.get_value<uint64_t>();
+      if (i == 1) vo.to = v.second.get_value<uint64_t>();
+      if (i == 2) vo.assumeValid = v.second.get_value<std::string>();
+      ++i;
+    }
+    auto last = std::chrono::steady_clock::now();
+    vo.progress = [&emit, &last](const QTC::ChainVerifier::Progress& pr) {
+      auto now = std::chrono::steady_clock::now();
+      if (now - last < std::chrono::seconds(1)) return true;
+      last = now;
+      PT l;
+      l.put("status", "progress");
+      l.put("height", static_cast<unsigned long long>(pr.height));
+      l.put("done", static_cast<unsigned long long>(pr.done));
+      l.put("total", static_cast<unsigned long long>(pr.total));
+      l.put("blocks_per_sec", static_cast<unsigned long long>(pr.blocksPerSec));
+      // a client that hung up cancels the run
+      return emit(l);
+    };
+    auto r = QTC::ChainVerifier::run(chain, vo);
+    PT l;
+    l.put("status", r.ok ? "ok" : "failed");
+    l.put("from", static_cast<unsigned long long>(r.from));
+    l.put("to", static_cast<unsigned long long>(r.to));
+    l.put("checked", static_cast<unsigned long long>(r.checked));
+    l.put("headers_only", static_cast<unsigned long long>(r.headersOnly));
+    l.put("assumed_valid", static_cast<unsigned long long>(r.assumed));
+    l.put("seconds", r.seconds);
+    l.put("blocks_per_sec", static_cast<unsigned long long>(r.blocksPerSec));
+    if (!r.ok) {
+      if (r.badHeight >= 0) l.put("bad_height", static_cast<unsigned long long>(r.badHeight));
+      l.put("error", r.error);
+    }
+    emit(l);
+  });
+
+  // subscribe([kinds...], [addresses...]): NDJSON push stream of "block",
+  // "tx" and "address" events (see rpc/EventBus.h)
+  rpc.addSubscribe("subscribe", [&events](const PT& p, const std::shared_ptr<QTC::RpcServer::Sink>& sink) {
+    QTC::EventBus::Filter f;
+    if (!QTC::EventBus::parseFilter(p, f)) throw std::invalid_argument("unknown event kind");
+    return events.subscribe(f, sink);
   });
 
-  rpc.start("127.0.0.1", 18443, 4);
+  // io threads only read and admit requests; calls run on the class workers
+  rpc.start("127.0.0.1", rpcPort, 2);
 
   for (;;) std::this_thread::sleep_for(std::chrono::seconds(60));
   return 0;
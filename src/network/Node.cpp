@@ -2,9 +2,13 @@
 #include "blockchain/Blockchain.h"
 #include "blockchain/Transaction.h"
 #include "blockchain/Block.h"
+#include "blockchain/Snapshot.h"
+#include "utils/Logger.h"
+#include "utils/Metrics.h"
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
-#include <iostream>
+#include <algorithm>
+#include <map>
 
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
@@ -12,7 +16,56 @@ using pt = boost::property_tree::ptree;
 
 namespace QTC {
 
-P2P::P2P(Blockchain* c) : chain_(c) {}
+namespace {
+constexpr int kMsgTypes = 11;
+const char* const kMsgNames[kMsgTypes] = { "hello", "inv", "getblocks", "block", "tx", "ping", "pong",
+                                           "getsnapshot", "snapshot", "getchunk", "chunk" };
+
+// chunk requests in flight per source peer
+constexpr size_t kChunkWindow = 4;
+// peer addresses that must offer the same snapshot root before it is used;
+// counting connections would let one host open several
+constexpr size_t kSnapQuorum = 2;
+
+std::string to_json(const pt& j) { std::ostringstream o; write_json(o, j, false); return o.str(); }
+
+struct P2PMetrics {
+  Counter* received[kMsgTypes];
+  Histogram* handle[kMsgTypes];
+  Counter& sent = Metrics::instance().counter("qtc_p2p_messages_sent_total", "P2P messages queued for sending");
+  Counter& bytes_in = Metrics::instance().counter("qtc_p2p_received_bytes_total", "Bytes read from peers");
+  Counter& bytes_out = Metrics::instance().counter("qtc_p2p_sent_bytes_total", "Bytes queued for peers");
+  Counter& decode_errors = Metrics::instance().counter("qtc_p2p_decode_errors_total", "P2P lines or payloads that failed to parse");
+  Counter& connect_errors = Metrics::instance().counter("qtc_p2p_connect_errors_total", "Failed outbound connections");
+  Gauge& peers = Metrics::instance().gauge("qtc_p2p_peers", "Connected peers");
+  Counter& bad_chunks = Metrics::instance().counter("qtc_p2p_snapshot_bad_chunks_total", "Snapshot chunks that failed verification");
+  Counter& snap_installed = Metrics::instance().counter("qtc_p2p_snapshots_installed_total", "State snapshots downloaded and installed");
+
+  P2PMetrics() {
+    for (int i = 0; i < kMsgTypes; ++i) {
+      auto lbl = Metrics::label("type", kMsgNames[i]);
+      received[i] = &Metrics::instance().counter("qtc_p2p_messages_received_total", "P2P messages received by type", lbl);
+      handle[i] = &Metrics::instance().timer("qtc_p2p_message_handle_duration_seconds", "P2P message handling latency by type", lbl);
+    }
+  }
+};
+P2PMetrics& p2p_metrics() { static P2PMetrics m; return m; }
+}
+
+struct P2P::SnapSync {
+  struct Req {
+    std::shared_ptr<Peer> peer;
+    std::chrono::steady_clock::time_point at;
+  };
+  std::shared_ptr<const Snapshot> manifest;
+  std::vector<std::string> data;
+  std::vector<bool> have;
+  size_t remaining{0};
+  std::map<size_t, Req> inflight;
+  std::vector<std::shared_ptr<Peer>> sources;
+};
+
+P2P::P2P(Blockchain* c) : chain_(c) { p2p_metrics(); }
 P2P::~P2P() { stop(); }
 
 void P2P::listen(unsigned short port) {
@@ -21,11 +74,22 @@ void P2P::listen(unsigned short port) {
   ioc_.reset(new net::io_context());
   acc_.reset(new tcp::acceptor(*ioc_, tcp::endpoint(tcp::v4(), port)));
   acc_->set_option(net::socket_base::reuse_address(true));
-  std::cout << "p2p listening on 0.0.0.0:" << port << "\n";
+  QTC_INFO(P2P, "listening on 0.0.0.0:%u", static_cast<unsigned>(this->port()));
   do_accept();
   workers_.emplace_back([this]{ ioc_->run(); });
 }
 
+unsigned short P2P::port() const {
+  if (!acc_) return 0;
+  boost::system::error_code ec;
+  auto ep = acc_->local_endpoint(ec);
+  return ec ? 0 : ep.port();
+}
+
+void P2P::setLinkLatency(std::chrono::milliseconds d) { latency_ = d; }
+
+void P2P::setSyncTimeout(std::chrono::milliseconds d) { snap_timeout_ = d; }
+
 void P2P::connect(const std::string& host, unsigned short port) {
   if (!ioc_) return;
   try {
@@ -36,15 +100,21 @@ void P2P::connect(const std::string& host, unsigned short port) {
     auto p = std::make_shared<Peer>();
     p->sock = s;
     p->remote = host + ":" + std::to_string(port);
+    boost::system::error_code rec;
+    auto ep = s->remote_endpoint(rec);
+    p->addr = rec ? host : ep.address().to_string();
     {
       std::lock_guard<std::mutex> lk(mu_);
       peers_.push_back(p);
+      p2p_metrics().peers.set(static_cast<double>(peers_.size()));
     }
-    start_read(p);
-    pt j; j.put("height", static_cast<unsigned long long>(chain_->getBlockCount()));
-    std::ostringstream o; write_json(o, j, false);
-    send_line(p, pack(Msg::Hello, o.str()));
-  } catch (...) {}
+    net::post(*ioc_, [this, p]{ start_read(p); });
+    send_hello(p);
+    QTC_DEBUG(P2P, "connected to %s", p->remote.c_str());
+  } catch (const std::exception& e) {
+    p2p_metrics().connect_errors.inc();
+    QTC_WARN(P2P, "connect %s:%u failed: %s", host.c_str(), static_cast<unsigned>(port), e.what());
+  }
 }
 
 void P2P::stop() {
@@ -54,9 +124,14 @@ void P2P::stop() {
   if (ioc_)  ioc_->stop();
   for (auto& t : workers_) if (t.joinable()) t.join();
   workers_.clear();
+  {
+    std::lock_guard<std::mutex> lk(snap_mu_);
+    snap_timer_.reset();
+  }
   {
     std::lock_guard<std::mutex> lk(mu_);
     peers_.clear();
+    p2p_metrics().peers.set(0);
   }
   acc_.reset();
   ioc_.reset();
@@ -69,36 +144,50 @@ void P2P::do_accept() {
     if (!ec) {
       auto p = std::make_shared<Peer>();
       p->sock = sock;
-      try {
-        p->remote = sock->remote_endpoint().address().to_string() + ":" +
-                    std::to_string(sock->remote_endpoint().port());
-      } catch (...) { p->remote = "unknown"; }
+      boost::system::error_code rec;
+      auto ep = sock->remote_endpoint(rec);
+      p->addr = rec ? "unknown" : ep.address().to_string();
+      p->remote = rec ? "unknown" : p->addr + ":" + std::to_string(ep.port());
+      QTC_DEBUG(P2P, "accepted %s", p->remote.c_str());
       {
         std::lock_guard<std::mutex> lk(mu_);
         peers_.push_back(p);
+        p2p_metrics().peers.set(static_cast<double>(peers_.size()));
       }
       start_read(p);
-      pt j; j.put("height", static_cast<unsigned long long>(chain_->getBlockCount()));
-      std::ostringstream o; write_json(o, j, false);
-      send_line(p, pack(Msg::Hello, o.str()));
+      send_hello(p);
+    } else if (running_) {
+      QTC_WARN(P2P, "accept failed: %s", ec.message().c_str());
     }
     if (running_) do_accept();
   });
 }
 
 void P2P::start_read(const std::shared_ptr<Peer>& p) {
-  auto buf = std::make_shared<net::streambuf>();
-  net::async_read_until(*p->sock, *buf, '\n',
-    [this, p, buf](const boost::system::error_code& ec, std::size_t){
+  // the streambuf lives in the peer: a read may pull in more than one line
+  net::async_read_until(*p->sock, p->inbuf, '\n',
+    [this, p](const boost::system::error_code& ec, std::size_t){
+      auto& m = p2p_metrics();
       if (ec) {
-        std::lock_guard<std::mutex> lk(mu_);
-        peers_.erase(std::remove(peers_.begin(), peers_.end(), p), peers_.end());
+        {
+          std::lock_guard<std::mutex> lk(mu_);
+          peers_.erase(std::remove(peers_.begin(), peers_.end(), p), peers_.end());
+          m.peers.set(static_cast<double>(peers_.size()));
+        }
+        snap_drop_peer(p);
+        QTC_DEBUG(P2P, "%s disconnected: %s", p->remote.c_str(), ec.message().c_str());
         return;
       }
-      std::istream is(buf.get());
+      std::istream is(&p->inbuf);
       std::string line; std::getline(is, line);
+      m.bytes_in.inc(line.size() + 1);
       Msg t; std::string payload;
-      if (unpack(line, t, payload)) on_msg(p, t, payload);
+      if (unpack(line, t, payload)) {
+        on_msg(p, t, payload);
+      } else {
+        m.decode_errors.inc();
+        QTC_DEBUG(P2P, "undecodable line from %s (%zu bytes)", p->remote.c_str(), line.size());
+      }
       start_read(p);
     });
 }
@@ -109,7 +198,10 @@ std::string P2P::pack(Msg type, const std::string& payload) {
 }
 bool P2P::unpack(const std::string& line, Msg& type, std::string& payload) {
   pt j; std::istringstream i(line);
-  try { read_json(i, j); } catch (...) { return false; }
+  try { read_json(i, j); } catch (const boost::property_tree::json_parser_error& e) {
+    QTC_TRACE(P2P, "unpack: %s", e.what());
+    return false;
+  }
   int t = j.get<int>("t", -1);
   type = static_cast<Msg>(t);
   payload = j.get<std::string>("p", "");
@@ -117,8 +209,34 @@ bool P2P::unpack(const std::string& line, Msg& type, std::string& payload) {
 }
 
 void P2P::send_line(const std::shared_ptr<Peer>& p, const std::string& line) {
-  if (!p || !p->sock) return;
-  net::async_write(*p->sock, net::buffer(line), [](auto, auto){});
+  if (!p || !p->sock || !ioc_) return;
+  auto& m = p2p_metrics();
+  m.sent.inc();
+  m.bytes_out.inc(line.size());
+  if (latency_.count() > 0) {
+    auto t = std::make_shared<net::steady_timer>(*ioc_, latency_);
+    t->async_wait([this, p, t, line](const boost::system::error_code& ec) {
+      if (!ec) enqueue_line(p, line);
+    });
+    return;
+  }
+  net::post(*ioc_, [this, p, line]() mutable { enqueue_line(p, std::move(line)); });
+}
+
+// io thread only: one async_write in flight per socket, the queued string
+// stays alive in the outbox until its write completes
+void P2P::enqueue_line(const std::shared_ptr<Peer>& p, std::string line) {
+  p->outbox.push_back(std::move(line));
+  if (p->outbox.size() == 1) write_next(p);
+}
+
+void P2P::write_next(const std::shared_ptr<Peer>& p) {
+  net::async_write(*p->sock, net::buffer(p->outbox.front()),
+    [this, p](const boost::system::error_code& ec, std::size_t) {
+      if (ec) { p->outbox.clear(); return; }
+      p->outbox.pop_front();
+      if (!p->outbox.empty()) write_next(p);
+    });
 }
 void P2P::send_all(const std::string& line, const std::shared_ptr<Peer>& except) {
   std::lock_guard<std::mutex> lk(mu_);
@@ -130,21 +248,287 @@ void P2P::trim_seen() {
   if (seen_block_.size() > max_seen_) { seen_block_.clear(); }
 }
 
+void P2P::send_hello(const std::shared_ptr<Peer>& p) {
+  pt j;
+  j.put("height", static_cast<unsigned long long>(chain_->getBlockCount()));
+  auto snap = chain_->latestSnapshot();
+  j.put("snapshot", static_cast<unsigned long long>(snap ? snap->height : 0));
+  // a pruned node only serves blocks from "low" up
+  j.put("pruned", chain_->isPruned() ? 1 : 0);
+  j.put("low", static_cast<unsigned long long>(chain_->getBaseHeight()));
+  send_line(p, pack(Msg::Hello, to_json(j)));
+}
+
+void P2P::request_blocks(const std::shared_ptr<Peer>& p) {
+  pt q; q.put("from", static_cast<unsigned long long>(chain_->getBlockCount()));
+  send_line(p, pack(Msg::GetBlocks, to_json(q)));
+}
+
+void P2P::request_blocks_all() {
+  std::vector<std::shared_ptr<Peer>> all;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    all = peers_;
+  }
+  uint64_t ours = chain_->getBlockCount();
+  for (auto& q : all) if (q->low <= ours) request_blocks(q);
+}
+
+// snap_mu_ held. Checks on the sync every half timeout.
+void P2P::snap_arm() {
+  if (!ioc_) return;
+  if (!snap_timer_) snap_timer_.reset(new net::steady_timer(*ioc_));
+  snap_timer_->expires_after(snap_timeout_ / 2);
+  snap_timer_->async_wait([this](const boost::system::error_code& ec) { if (!ec) snap_check(); });
+}
+
+// Sources that sat on a request past the timeout are retired and their
+// chunks go to the others; with no source left, or no manifest agreed on
+// within the timeout, the node replays blocks instead.
+void P2P::snap_check() {
+  bool fallback = false;
+  {
+    std::lock_guard<std::mutex> lk(snap_mu_);
+    if (!snap_wanted_) return;
+    auto now = std::chrono::steady_clock::now();
+    if (!snap_) {
+      fallback = now - snap_since_ >= snap_timeout_;
+    } else {
+      auto& s = *snap_;
+      std::vector<std::shared_ptr<Peer>> stale;
+      for (const auto& r : s.inflight)
+        if (now - r.second.at >= snap_timeout_ && std::find(stale.begin(), stale.end(), r.second.peer) == stale.end())
+          stale.push_back(r.second.peer);
+      for (const auto& q : stale) {
+        QTC_DEBUG(P2P, "snapshot source %s timed out", q->remote.c_str());
+        s.sources.erase(std::remove(s.sources.begin(), s.sources.end(), q), s.sources.end());
+      }
+      for (auto it = s.inflight.begin(); it != s.inflight.end();) {
+        if (std::find(stale.begin(), stale.end(), it->second.peer) != stale.end()) it = s.inflight.erase(it);
+        else ++it;
+      }
+      if (s.sources.empty()) fallback = true;
+      else for (auto& q : s.sources) snap_request_more(q);
+    }
+    if (fallback) {
+      QTC_WARN(P2P, "snapshot sync stalled; replaying blocks instead");
+      snap_abandon();
+    } else {
+      snap_arm();
+    }
+  }
+  if (fallback) request_blocks_all();
+}
+
+// snap_mu_ held. Downloads the offered root from the peers that agreed on it.
+void P2P::snap_start(const SnapOffer& o) {
+  snap_.reset(new SnapSync);
+  snap_->manifest = o.manifest;
+  snap_->data.resize(o.manifest->chunkHashes.size());
+  snap_->have.assign(o.manifest->chunkHashes.size(), false);
+  snap_->remaining = o.manifest->chunkHashes.size();
+  snap_->sources = o.peers;
+  snap_offers_.clear();
+  for (auto& q : snap_->sources) snap_request_more(q);
+}
+
+// snap_mu_ held. The caller requests blocks once the lock is released.
+void P2P::snap_abandon() {
+  snap_.reset();
+  snap_wanted_ = false;
+  snap_offers_.clear();
+  snap_asked_ = 0;
+}
+
+// snap_mu_ held. Tops the peer up to kChunkWindow outstanding requests,
+// taking over requests that another source left unanswered for too long.
+void P2P::snap_request_more(const std::shared_ptr<Peer>& p) {
+  auto& s = *snap_;
+  if (std::find(s.sources.begin(), s.sources.end(), p) == s.sources.end()) return;
+  auto now = std::chrono::steady_clock::now();
+  size_t mine = 0;
+  for (auto& r : s.inflight) {
+    if (r.second.peer != p && now - r.second.at > snap_timeout_) r.second = SnapSync::Req{p, now};
+    if (r.second.peer == p) ++mine;
+  }
+  auto ask = [this, &p, &s](size_t i) {
+    pt q; q.put("root", s.manifest->root); q.put("i", static_cast<unsigned long long>(i));
+    send_line(p, pack(Msg::GetChunk, to_json(q)));
+  };
+  for (auto& r : s.inflight) if (r.second.peer == p && r.second.at == now) ask(r.first);
+  for (size_t i = 0; i < s.have.size() && mine < kChunkWindow; ++i) {
+    if (s.have[i] || s.inflight.count(i)) continue;
+    s.inflight[i] = SnapSync::Req{p, now};
+    ask(i);
+    ++mine;
+  }
+}
+
+void P2P::snap_drop_peer(const std::shared_ptr<Peer>& p) {
+  std::vector<std::shared_ptr<Peer>> rest;
+  {
+    std::lock_guard<std::mutex> lk(snap_mu_);
+    if (!snap_) {
+      for (auto& o : snap_offers_) o.second.peers.erase(std::remove(o.second.peers.begin(), o.second.peers.end(), p),
+                                                       o.second.peers.end());
+      return;
+    }
+    auto& s = *snap_;
+    s.sources.erase(std::remove(s.sources.begin(), s.sources.end(), p), s.sources.end());
+    for (auto it = s.inflight.begin(); it != s.inflight.end();) {
+      if (it->second.peer == p) it = s.inflight.erase(it); else ++it;
+    }
+    if (s.sources.empty()) {
+      // nobody left to serve this root: start over with whatever peers offer
+      snap_.reset();
+      snap_since_ = std::chrono::steady_clock::now();
+    } else {
+      for (auto& q : s.sources) snap_request_more(q);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk2(mu_);
+      rest = peers_;
+    }
+    rest.erase(std::remove(rest.begin(), rest.end(), p), rest.end());
+    snap_asked_ = rest.size();
+  }
+  for (auto& q : rest) send_line(q, pack(Msg::GetSnapshot, "{}"));
+}
+
+// Every chunk verified: install the state, then fetch the blocks after it.
+void P2P::snap_finish() {
+  std::unique_ptr<SnapSync> done;
+  {
+    std::lock_guard<std::mutex> lk(snap_mu_);
+    done = std::move(snap_);
+    snap_wanted_ = false;
+  }
+  std::map<std::string, uint64_t> balances;
+  bool ok = true;
+  for (const auto& d : done->data) ok = ok && Snapshot::parseChunk(d, balances);
+  if (ok && chain_->installSnapshot(*done->manifest, std::move(balances))) p2p_metrics().snap_installed.inc();
+  request_blocks_all();
+}
+
 void P2P::on_msg(const std::shared_ptr<Peer>& p, Msg type, const std::string& payload) {
+  auto& m = p2p_metrics();
+  int ti = static_cast<int>(type);
+  if (ti < 0 || ti >= kMsgTypes) { m.decode_errors.inc(); return; }
+  m.received[ti]->inc();
+  ScopedTimer timer(*m.handle[ti]);
+  QTC_DEBUG(P2P, "%s from %s (%zu bytes)", kMsgNames[ti], p->remote.c_str(), payload.size());
+
   if (type == Msg::Hello) {
-    // request missing blocks if peer is ahead
-    pt j; std::istringstream i(payload); try { read_json(i, j); } catch (...) { return; }
+    pt j; std::istringstream i(payload); try { read_json(i, j); } catch (...) { m.decode_errors.inc(); return; }
     uint64_t h = j.get<uint64_t>("height", 0);
-    if (h > chain_->getBlockCount()) {
-      pt q; q.put("from", static_cast<unsigned long long>(chain_->getBlockCount()));
-      std::ostringstream o; write_json(o, q, false);
-      send_line(p, pack(Msg::GetBlocks, o.str()));
+    uint64_t snap = j.get<uint64_t>("snapshot", 0);
+    uint64_t ours = chain_->getBlockCount();
+    p->low = j.get<uint64_t>("low", 0);
+    bool fast = false;
+    {
+      std::lock_guard<std::mutex> lk(snap_mu_);
+      // a fresh node bootstraps from a snapshot instead of replaying history
+      if (ours == 1 && snap > 1) {
+        if (!snap_wanted_) {
+          snap_wanted_ = true;
+          snap_since_ = std::chrono::steady_clock::now();
+          snap_arm();
+        }
+        ++snap_asked_;
+        fast = true;
+      }
+      else if (snap_wanted_) return; // blocks are requested once the snapshot is in
+    }
+    if (fast) send_line(p, pack(Msg::GetSnapshot, "{}"));
+    else if (h > ours && p->low <= ours) request_blocks(p);
+    return;
+  }
+
+  if (type == Msg::GetSnapshot) {
+    auto s = chain_->latestSnapshot();
+    send_line(p, pack(Msg::Snapshot, s ? to_json(s->manifest()) : "{}"));
+    return;
+  }
+
+  if (type == Msg::Snapshot) {
+    pt j; std::istringstream i(payload); try { read_json(i, j); } catch (...) { m.decode_errors.inc(); return; }
+    auto s = Snapshot::fromManifest(j, chain_->getDifficulty());
+    bool fallback = false;
+    {
+      std::lock_guard<std::mutex> lk(snap_mu_);
+      if (!snap_wanted_) return;
+      if (snap_asked_) --snap_asked_;
+      if (snap_) {
+        if (s && snap_->manifest->root == s->root &&
+            std::find(snap_->sources.begin(), snap_->sources.end(), p) == snap_->sources.end()) {
+          snap_->sources.push_back(p);
+          snap_request_more(p);
+        }
+      } else if (s) {
+        // a lone peer can make up any state; wait for another to agree
+        // (the timer gives up on the snapshot if none does)
+        auto& o = snap_offers_[s->root];
+        if (!o.manifest) o.manifest = s;
+        if (std::find(o.peers.begin(), o.peers.end(), p) == o.peers.end()) o.peers.push_back(p);
+        std::unordered_set<std::string> addrs;
+        for (const auto& q : o.peers) addrs.insert(q->addr);
+        if (addrs.size() >= kSnapQuorum) snap_start(o);
+      } else if (snap_asked_ == 0 && snap_offers_.empty()) {
+        // nobody offers a (valid) snapshot
+        snap_abandon();
+        fallback = true;
+      }
     }
+    if (fallback) request_blocks_all();
+    return;
+  }
+
+  if (type == Msg::GetChunk) {
+    pt j; std::istringstream i(payload); try { read_json(i, j); } catch (...) { m.decode_errors.inc(); return; }
+    auto s = chain_->latestSnapshot();
+    uint64_t k = j.get<uint64_t>("i", 0);
+    pt r;
+    r.put("root", j.get<std::string>("root", ""));
+    r.put("i", static_cast<unsigned long long>(k));
+    // an empty reply tells the requester this root is no longer served
+    if (s && s->root == r.get<std::string>("root") && k < s->chunks.size()) r.put("data", s->chunks[k]);
+    else r.put("missing", 1);
+    send_line(p, pack(Msg::Chunk, to_json(r)));
+    return;
+  }
+
+  if (type == Msg::Chunk) {
+    pt j; std::istringstream i(payload); try { read_json(i, j); } catch (...) { m.decode_errors.inc(); return; }
+    size_t k = static_cast<size_t>(j.get<uint64_t>("i", 0));
+    bool drop = false, finished = false;
+    {
+      std::lock_guard<std::mutex> lk(snap_mu_);
+      if (!snap_ || j.get<std::string>("root", "") != snap_->manifest->root) return;
+      auto& s = *snap_;
+      if (j.get<int>("missing", 0)) {
+        drop = true;
+      } else if (k < s.have.size() && !s.have[k]) {
+        std::string data = j.get<std::string>("data", "");
+        if (s.manifest->checkChunk(k, data)) {
+          s.data[k] = std::move(data);
+          s.have[k] = true;
+          s.inflight.erase(k);
+          finished = --s.remaining == 0;
+        } else {
+          m.bad_chunks.inc();
+          drop = true;
+        }
+      }
+      if (!drop && !finished) snap_request_more(p);
+    }
+    if (drop) snap_drop_peer(p);
+    if (finished) snap_finish();
     return;
   }
 
   if (type == Msg::GetBlocks) {
-    pt j; std::istringstream i(payload); try { read_json(i, j); } catch (...) { return; }
+    pt j; std::istringstream i(payload); try { read_json(i, j); } catch (...) { m.decode_errors.inc(); return; }
     uint64_t from = j.get<uint64_t>("from", 0);
     for (uint64_t k = from; k < chain_->getBlockCount(); ++k) {
       auto b = chain_->getBlockCopyByIndex(k);
@@ -157,44 +541,79 @@ void P2P::on_msg(const std::shared_ptr<Peer>& p, Msg type, const std::string& pa
   }
 
   if (type == Msg::Block) {
-    pt b; std::istringstream i(payload); try { read_json(i, b); } catch (...) { return; }
+    pt b; std::istringstream i(payload); try { read_json(i, b); } catch (...) { m.decode_errors.inc(); return; }
     auto blk = QTC::Block::fromPtree(b);
-    if (!blk) return;
-    std::string h = b.get<std::string>("hash", "");
+    if (!blk || !blk->hasValidHash()) return;
+    for (const auto& tx : blk->getTransactions())
+      if (!tx.hasValidId()) return;
+    // The hash does not cover signatures, so a copy with the real hash can
+    // still be forged: the mark is dropped again if the block is refused,
+    // or the genuine one would be ignored after it.
+    const std::string& h = blk->getHash();
     {
       std::lock_guard<std::mutex> lk(seen_mu_);
-      if (seen_block_.count(h)) return;
-      seen_block_.insert(h);
+      if (!seen_block_.insert(h).second) return;
       trim_seen();
     }
     if (chain_->addBlockFromPeer(*blk)) {
       send_all(pack(Msg::Block, payload), p);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(seen_mu_);
+      seen_block_.erase(h);
+    }
+    if (blk->getIndex() > chain_->getBlockCount()) {
+      // we are missing blocks in between: fetch them and let this one be
+      // accepted when it arrives again in order
+      bool syncing;
+      {
+        std::lock_guard<std::mutex> lk(snap_mu_);
+        syncing = snap_wanted_;
+      }
+      if (!syncing && p->low <= chain_->getBlockCount()) request_blocks(p);
     }
     return;
   }
 
   if (type == Msg::Tx) {
-    pt t; std::istringstream i(payload); try { read_json(i, t); } catch (...) { return; }
+    pt t; std::istringstream i(payload); try { read_json(i, t); } catch (...) { m.decode_errors.inc(); return; }
     auto tx = QTC::Transaction::fromPtree(t);
     if (!tx) return;
-    std::string id = tx->getId();
+    // the id is as sent: the mark is dropped again if the tx is refused, so
+    // a forged one carrying a real id cannot shadow the genuine tx
+    const std::string& id = tx->getId();
     {
       std::lock_guard<std::mutex> lk(seen_mu_);
-      if (seen_tx_.count(id)) return;
-      seen_tx_.insert(id);
+      if (!seen_tx_.insert(id).second) return;
       trim_seen();
     }
-    chain_->addTransaction(*tx);
-    send_all(pack(Msg::Tx, payload), p);
+    if (chain_->addTransaction(*tx)) {
+      send_all(pack(Msg::Tx, payload), p);
+      return;
+    }
+    std::lock_guard<std::mutex> lk(seen_mu_);
+    seen_tx_.erase(id);
     return;
   }
 }
 
 void P2P::broadcastTx(const Transaction& t) {
+  {
+    // relayed txs are marked in on_msg, which forwards them itself
+    std::lock_guard<std::mutex> lk(seen_mu_);
+    if (!seen_tx_.insert(t.getId()).second) return;
+    trim_seen();
+  }
   auto tp = t.toPtree(); std::ostringstream o; write_json(o, tp, false);
   send_all(pack(Msg::Tx, o.str()));
 }
 void P2P::broadcastBlock(const Block& b) {
+  {
+    std::lock_guard<std::mutex> lk(seen_mu_);
+    seen_block_.insert(b.getHash());
+    trim_seen();
+  }
   auto bp = b.toPtree(); std::ostringstream o; write_json(o, bp, false);
   send_all(pack(Msg::Block, o.str()));
 }
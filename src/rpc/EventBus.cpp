@@ -0,0 +1,170 @@
+// src/rpc/EventBus.cpp
+#include "rpc/EventBus.h"
+#include "blockchain/Block.h"
+#include "blockchain/Blockchain.h"
+#include "blockchain/Transaction.h"
+#include "utils/Metrics.h"
+#include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <sstream>
+
+using pt = boost::property_tree::ptree;
+
+namespace QTC {
+
+namespace {
+struct EventMetrics {
+  Counter& blocks = Metrics::instance().counter("qtc_events_published_total", "Events fanned out to subscribers", Metrics::label("kind", "block"));
+  Counter& txs = Metrics::instance().counter("qtc_events_published_total", "Events fanned out to subscribers", Metrics::label("kind", "tx"));
+  Counter& addresses = Metrics::instance().counter("qtc_events_published_total", "Events fanned out to subscribers", Metrics::label("kind", "address"));
+  Counter& dropped = Metrics::instance().counter("qtc_events_dropped_total", "Events lost to subscribers whose queue was full");
+  Gauge& subscribers = Metrics::instance().gauge("qtc_events_subscribers", "Subscribed push streams");
+};
+EventMetrics& event_metrics() { static EventMetrics m; return m; }
+
+std::string line(const pt& j) { std::ostringstream o; write_json(o, j, false); return o.str(); }
+
+pt tx_fields(const Transaction& tx) {
+  pt j;
+  j.put("id", tx.getId());
+  j.put("from", tx.getFrom());
+  j.put("to", tx.getTo());
+  j.put("amount", static_cast<unsigned long long>(tx.getAmount()));
+  j.put("fee", static_cast<unsigned long long>(tx.getFee()));
+  return j;
+}
+}
+
+void EventBus::attach(Blockchain& chain) {
+  chain.addBlockListener([this](const Block& b) { publishBlock(b); });
+  chain.addTxListener([this](const Transaction& tx) { publishTx(tx); });
+}
+
+bool EventBus::parseFilter(const RpcServer::PTree& params, Filter& out) {
+  out = Filter{};
+  int i = 0;
+  for (const auto& v : params) {
+    if (i == 0 && !v.second.empty()) {
+      out.kinds = 0;
+      for (const auto& k : v.second) {
+        std::string s = k.second.get_value<std::string>();
+        if (s == "block") out.kinds |= Blocks;
+        else if (s == "tx") out.kinds |= Txs;
+        else if (s == "address") out.kinds |= Addresses;
+        else return false;
+      }
+    }
+    if (i == 1) {
+      for (const auto& a : v.second) out.addresses.push_back(a.second.get_value<std::string>());
+      if (!out.addresses.empty()) out.kinds |= Addresses;
+    }
+    ++i;
+  }
+  std::sort(out.addresses.begin(), out.addresses.end());
+  out.addresses.erase(std::unique(out.addresses.begin(), out.addresses.end()), out.addresses.end());
+  return out.kinds != 0;
+}
+
+bool EventBus::subscribe(const Filter& f, const std::shared_ptr<RpcServer::Sink>& sink) {
+  std::lock_guard<std::mutex> lk(mu_);
+  reap();
+  if (subs_.size() >= kMaxSubscribers) return false;
+  subs_.emplace_back(new Sub{f, sink, 0, false});
+  Sub* s = subs_.back().get();
+  if (f.kinds & Addresses)
+    for (const auto& a : f.addresses) watch_[a].push_back(s);
+  event_metrics().subscribers.set(static_cast<double>(subs_.size()));
+  return true;
+}
+
+size_t EventBus::subscribers() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return subs_.size();
+}
+
+// mu_ held
+void EventBus::deliver(Sub& s, const std::string& l) {
+  using Status = RpcServer::Sink::Status;
+  if (s.dead) return;
+  if (s.dropped) {
+    pt j; j.put("event", "dropped"); j.put("count", static_cast<unsigned long long>(s.dropped));
+    Status st = s.sink->push(line(j));
+    if (st == Status::Closed) { s.dead = true; return; }
+    if (st == Status::Full) { ++s.dropped; event_metrics().dropped.inc(); return; }
+    s.dropped = 0;
+  }
+  Status st = s.sink->push(l);
+  if (st == Status::Closed) s.dead = true;
+  else if (st == Status::Full) { ++s.dropped; event_metrics().dropped.inc(); }
+}
+
+// mu_ held. Watchers of either side of tx; a self-transfer is one event.
+void EventBus::addressEvents(const Transaction& tx, bool confirmed, uint64_t height) {
+  if (watch_.empty()) return;
+  for (const std::string* a : {&tx.getFrom(), &tx.getTo()}) {
+    if (a == &tx.getTo() && tx.getTo() == tx.getFrom()) break;
+    auto it = watch_.find(*a);
+    if (it == watch_.end()) continue;
+    pt j = tx_fields(tx);
+    j.put("event", "address");
+    j.put("address", *a);
+    j.put("confirmed", confirmed ? 1 : 0);
+    if (confirmed) j.put("height", static_cast<unsigned long long>(height));
+    std::string l = line(j);
+    for (Sub* s : it->second) deliver(*s, l);
+    event_metrics().addresses.inc();
+  }
+}
+
+void EventBus::publishBlock(const Block& b) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (subs_.empty()) return;
+  pt j;
+  j.put("event", "block");
+  j.put("height", static_cast<unsigned long long>(b.getIndex()));
+  j.put("hash", b.getHash());
+  j.put("prev", b.getPrev());
+  j.put("time", static_cast<unsigned long long>(b.getTimestamp()));
+  j.put("txs", static_cast<unsigned long long>(b.getTransactions().size()));
+  std::string l = line(j);
+  for (auto& s : subs_) if (s->filter.kinds & Blocks) deliver(*s, l);
+  event_metrics().blocks.inc();
+  for (const auto& tx : b.getTransactions()) addressEvents(tx, true, b.getIndex());
+  reap();
+}
+
+void EventBus::publishTx(const Transaction& tx) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (subs_.empty()) return;
+  bool any = false;
+  for (auto& s : subs_) if (s->filter.kinds & Txs) { any = true; break; }
+  if (any) {
+    pt j = tx_fields(tx);
+    j.put("event", "tx");
+    std::string l = line(j);
+    for (auto& s : subs_) if (s->filter.kinds & Txs) deliver(*s, l);
+    event_metrics().txs.inc();
+  }
+  addressEvents(tx, false, 0);
+  reap();
+}
+
+// mu_ held. Forgets subscribers whose stream closed.
+void EventBus::reap() {
+  bool any = false;
+  for (auto& s : subs_) {
+    if (!s->dead && s->sink->closed()) s->dead = true;
+    any = any || s->dead;
+  }
+  if (!any) return;
+  for (auto it = watch_.begin(); it != watch_.end();) {
+    auto& v = it->second;
+    v.erase(std::remove_if(v.begin(), v.end(), [](Sub* s) { return s->dead; }), v.end());
+    if (v.empty()) it = watch_.erase(it); else ++it;
+  }
+  subs_.erase(std::remove_if(subs_.begin(), subs_.end(), [](const std::unique_ptr<Sub>& s) { return s->dead; }),
+              subs_.end());
+  event_metrics().subscribers.set(static_cast<double>(subs_.size()));
+}
+
+}
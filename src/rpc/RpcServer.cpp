@@ -1,11 +1,22 @@
 // src/rpc/RpcServer.cpp
 #include "rpc/RpcServer.h"
+#include "utils/Logger.h"
+#include "utils/Metrics.h"
 #include <boost/asio.hpp>
 #include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <array>
 #include <atomic>
-#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
+#include <poll.h>
 
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
@@ -19,15 +30,224 @@ static bool pt_parse(const std::string& s, boost::property_tree::ptree& out) {
   std::istringstream i(s); try { boost::property_tree::read_json(i, out); return true; } catch (...) { return false; }
 }
 
+namespace {
+struct RpcMetrics {
+  Counter& bytes_in = Metrics::instance().counter("qtc_rpc_received_bytes_total", "Bytes read from RPC clients");
+  Counter& bytes_out = Metrics::instance().counter("qtc_rpc_sent_bytes_total", "Bytes written to RPC clients");
+  Counter& err_parse = Metrics::instance().counter("qtc_rpc_errors_total", "Failed RPC requests", Metrics::label("kind", "parse"));
+  Counter& err_method = Metrics::instance().counter("qtc_rpc_errors_total", "Failed RPC requests", Metrics::label("kind", "method_not_found"));
+  Counter& err_exception = Metrics::instance().counter("qtc_rpc_errors_total", "Failed RPC requests", Metrics::label("kind", "exception"));
+  Counter& err_stream = Metrics::instance().counter("qtc_rpc_errors_total", "Failed RPC requests", Metrics::label("kind", "stream_aborted"));
+  Gauge& subscriptions = Metrics::instance().gauge("qtc_rpc_subscriptions", "Open push streams");
+  Counter& scrapes = Metrics::instance().counter("qtc_rpc_metrics_scrapes_total", "Requests served on /metrics");
+  Gauge& inflight = Metrics::instance().gauge("qtc_rpc_inflight_requests", "RPC sessions currently being handled");
+};
+RpcMetrics& rpc_metrics() { static RpcMetrics m; return m; }
+
+constexpr int kClasses = 3;
+const char* const kClassNames[kClasses] = { "cheap", "normal", "heavy" };
+
+// requests larger than this (headers + body) are refused
+constexpr size_t kMaxRequest = 1 << 20;
+// client buckets kept before idle (full) ones are evicted
+constexpr size_t kMaxClients = 4096;
+
+constexpr int kOverloaded = -32005;
+
+
+std::string chunk(const std::string& data) {
+  char head[20];
+  int n = std::snprintf(head, sizeof(head), "%zx\r\n", data.size());
+  std::string out(head, static_cast<size_t>(n));
+  out.reserve(out.size() + data.size() + 2);
+  out += data;
+  out += "\r\n";
+  return out;
+}
+
+struct InflightGuard {
+  explicit InflightGuard(Gauge& g) : g_(g) { g_.add(1); }
+  ~InflightGuard() { g_.add(-1); }
+  Gauge& g_;
+};
+}
+
 struct RpcServer::Impl {
+  using Clock = std::chrono::steady_clock;
+
+  struct Route {
+    Handler h;
+    StreamHandler stream;
+    SubscribeHandler subscribe;
+    size_t queue{0};
+    Cost cost{Cost::Normal};
+    Counter* calls{nullptr};
+    Histogram* latency{nullptr};
+  };
+
+  // one accepted connection, from the first read until the reply is written.
+  // The socket's executor is a strand, so completions on it never overlap.
+  struct Session {
+    explicit Session(net::io_context& ioc) : sock(net::make_strand(ioc)), buf(kMaxRequest) {}
+    tcp::socket sock;
+    net::streambuf buf;
+    std::string ip;
+    std::string id;
+    boost::property_tree::ptree params;
+    Route route;
+    bool metrics{false};
+    Clock::time_point queued;
+  };
+  using SessionPtr = std::shared_ptr<Session>;
+
+  // Push stream over a session's socket. push() runs on chain and miner
+  // threads, so it only queues under mu_; every socket operation is started
+  // on the socket's strand. One async_write is in flight at a time, the next
+  // one started from its completion. A read that completes (EOF or error)
+  // means the client left.
+  class PushSink : public Sink, public std::enable_shared_from_this<PushSink> {
+  public:
+    PushSink(SessionPtr s, size_t limit) : s_(std::move(s)), limit_(limit) {
+      q_.push_back(http_200_chunked());
+    }
+    ~PushSink() override { if (started_) rpc_metrics().subscriptions.add(-1); }
+
+    Status push(const std::string& line) override {
+      bool idle;
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (closed_) return Status::Closed;
+        if (q_.size() >= limit_) return Status::Full;
+        q_.push_back(chunk(line));
+        // a write in flight picks the line up from its completion
+        idle = started_ && !writing_;
+      }
+      if (idle) post_kick();
+      return Status::Queued;
+    }
+
+    bool closed() const override {
+      std::lock_guard<std::mutex> lk(mu_);
+      return closed_;
+    }
+
+    void start() {
+      rpc_metrics().subscriptions.add(1);
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        started_ = true;
+      }
+      auto self = shared_from_this();
+      net::post(s_->sock.get_executor(), [self] {
+        self->s_->sock.async_read_some(net::buffer(self->probe_), [self](const boost::system::error_code&, size_t) {
+          std::lock_guard<std::mutex> lk(self->mu_);
+          self->closed_ = true;
+          // a write in flight still reads q_.front(): cancel it and let its
+          // completion clear the queue
+          if (self->writing_) {
+            boost::system::error_code ec;
+            self->s_->sock.cancel(ec);
+          } else {
+            self->q_.clear();
+          }
+        });
+        std::lock_guard<std::mutex> lk(self->mu_);
+        self->kick();
+      });
+    }
+
+  private:
+    void post_kick() {
+      auto self = shared_from_this();
+      net::post(s_->sock.get_executor(), [self] {
+        std::lock_guard<std::mutex> lk(self->mu_);
+        self->kick();
+      });
+    }
+
+    // on the strand, mu_ held
+    void kick() {
+      if (!started_ || writing_ || q_.empty() || closed_) return;
+      writing_ = true;
+      auto self = shared_from_this();
+      net::async_write(s_->sock, net::buffer(q_.front()), [self](const boost::system::error_code& ec, size_t n) {
+        rpc_metrics().bytes_out.inc(n);
+        std::lock_guard<std::mutex> lk(self->mu_);
+        self->writing_ = false;
+        if (ec || self->closed_) { self->closed_ = true; self->q_.clear(); return; }
+        if (!self->q_.empty()) self->q_.pop_front();
+        self->kick();
+      });
+    }
+
+    SessionPtr s_;
+    size_t limit_;
+    mutable std::mutex mu_;
+    std::deque<std::string> q_; // front is being written while writing_
+    bool started_{false};
+    bool writing_{false};
+    bool closed_{false};
+    char probe_[1];
+  };
+
+  struct Lane {
+    Limits limits;
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<SessionPtr> q;
+    std::vector<std::thread> threads;
+    Gauge* depth{nullptr};
+    Histogram* wait{nullptr};
+    Counter* rejected_rate{nullptr};
+    Counter* rejected_busy{nullptr};
+  };
+
+  struct Bucket {
+    double tokens{-1}; // < 0: not used yet, starts full
+    Clock::time_point last;
+  };
+
   net::io_context ioc;
   std::unique_ptr<tcp::acceptor> acc;
   std::vector<std::thread> workers;
-  std::unordered_map<std::string, Handler> routes;
+  std::unordered_map<std::string, Route> routes;
   std::mutex mu;
   std::atomic<bool> running{false};
+  // replies and stream items are written from worker threads; a client
+  // that accepts nothing for this long is dropped instead of holding one
+  std::chrono::milliseconds write_timeout{10000};
+  Lane lanes[kClasses];
+  std::mutex bucket_mu;
+  std::unordered_map<std::string, std::array<Bucket, kClasses>> buckets;
+
+  Impl() {
+    for (int c = 0; c < kClasses; ++c) {
+      auto lbl = Metrics::label("class", kClassNames[c]);
+      Lane& l = lanes[c];
+      l.limits = defaultLimits(static_cast<Cost>(c));
+      l.depth = &Metrics::instance().gauge("qtc_rpc_queue_depth", "Admitted RPC calls waiting for a worker", lbl);
+      l.wait = &Metrics::instance().timer("qtc_rpc_queue_wait_seconds", "Time admitted RPC calls waited for a worker", lbl);
+      l.rejected_rate = &Metrics::instance().counter("qtc_rpc_rejected_total", "RPC calls refused by admission control",
+                                                     lbl + "," + Metrics::label("reason", "rate"));
+      l.rejected_busy = &Metrics::instance().counter("qtc_rpc_rejected_total", "RPC calls refused by admission control",
+                                                     lbl + "," + Metrics::label("reason", "busy"));
+    }
+  }
 
-  void add(const std::string& m, Handler h) { std::lock_guard<std::mutex> lk(mu); routes[m] = std::move(h); }
+  void add(const std::string& m, Handler h, StreamHandler stream, Cost cost,
+           SubscribeHandler subscribe = nullptr, size_t queue = 0) {
+    auto lbl = Metrics::label("method", m);
+    Route r;
+    r.h = std::move(h);
+    r.stream = std::move(stream);
+    r.subscribe = std::move(subscribe);
+    r.queue = queue;
+    r.cost = cost;
+    r.calls = &Metrics::instance().counter("qtc_rpc_requests_total", "RPC calls by method", lbl);
+    r.latency = &Metrics::instance().timer("qtc_rpc_request_duration_seconds", "RPC handler latency by method", lbl);
+    std::lock_guard<std::mutex> lk(mu);
+    routes[m] = std::move(r);
+  }
 
   static std::string http_200(const std::string& body) {
     std::ostringstream o;
@@ -40,6 +260,53 @@ struct RpcServer::Impl {
     return o.str();
   }
 
+  // JSON-RPC errors still travel in a 200
+  static std::string http_rpc_error(const std::string& id, int code, const std::string& msg) {
+    boost::property_tree::ptree res, err;
+    res.put("jsonrpc", "2.0");
+    res.put("id", id);
+    err.put("code", code); err.put("message", msg);
+    res.add_child("error", err);
+    return http_200(pt_dump(res));
+  }
+
+  static const char* http_200_chunked() {
+    return "HTTP/1.1 200 OK\r\n"
+           "Content-Type: application/x-ndjson\r\n"
+           "Access-Control-Allow-Origin: *\r\n"
+           "Transfer-Encoding: chunked\r\n"
+           "Connection: close\r\n\r\n";
+  }
+
+  // One chunk per item, written as soon as it is serialized, so the client
+  // sees the first item before the last one exists and nothing accumulates
+  // here. A write error or timeout (client gone or not reading) and server
+  // shutdown turn emit() false. The headers go out with the first item, so
+  // a handler that throws before emitting still gets an error reply; one
+  // that throws later leaves the body unterminated.
+  void stream(tcp::socket& s, const Route& r, const boost::property_tree::ptree& params) {
+    auto& m = rpc_metrics();
+    bool started = false, open = true;
+    auto emit = [this, &s, &started, &open, &m](const boost::property_tree::ptree& item) {
+      if (!open) return false;
+      // write_json ends the line with '\n'
+      open = running.load() && (started || reply(s, http_200_chunked())) && reply(s, chunk(pt_dump(item)));
+      started = true;
+      if (!open) m.err_stream.inc();
+      return open;
+    };
+    try {
+      r.stream(params, emit);
+    } catch (const std::exception& e) {
+      if (!started) throw;
+      m.err_stream.inc();
+      QTC_WARN(RPC, "stream aborted: %s", e.what());
+      return;
+    }
+    if (!started) reply(s, http_200_chunked());
+    if (open) reply(s, "0\r\n\r\n");
+  }
+
   static std::string http_400() {
     static const char* body = "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"parse error\"},\"id\":null}";
     std::ostringstream o;
@@ -52,11 +319,67 @@ struct RpcServer::Impl {
     return o.str();
   }
 
-  static bool parse_http_request(const std::string& req, std::string& body_out) {
-    auto p = req.find("\r\n\r\n");
-    if (p == std::string::npos) return false;
-    std::string headers = req.substr(0, p + 4);
-    std::string body = req.substr(p + 4);
+  static std::string http_metrics(const std::string& body) {
+    std::ostringstream o;
+    o << "HTTP/1.1 200 OK\r\n"
+      << "Content-Type: text/plain; version=0.0.4\r\n"
+      << "Content-Length: " << body.size() << "\r\n"
+      << "Connection: close\r\n\r\n"
+      << body;
+    return o.str();
+  }
+
+  static bool is_metrics_request(const std::string& req) {
+    return req.compare(0, 13, "GET /metrics ") == 0 || req.compare(0, 13, "GET /metrics?") == 0;
+  }
+
+  // also used on the io threads, so it must not throw; a client that went
+  // away just loses its reply
+  // Blocking write that gives up once the socket has taken no data for
+  // write_timeout (net::write would wait on a stalled client forever).
+  size_t write_for(tcp::socket& s, const std::string& data, boost::system::error_code& ec) {
+    size_t done = 0;
+    s.non_blocking(true, ec);
+    while (!ec && done < data.size()) {
+      done += s.write_some(net::buffer(data.data() + done, data.size() - done), ec);
+      if (ec != net::error::would_block && ec != net::error::try_again) continue;
+      pollfd pfd{s.native_handle(), POLLOUT, 0};
+      int r = ::poll(&pfd, 1, static_cast<int>(write_timeout.count()));
+      if (r == 0) ec = net::error::timed_out;
+      else if (r < 0 && errno != EINTR) ec.assign(errno, boost::system::system_category());
+      else ec.clear();
+    }
+    return done;
+  }
+
+  // false if the client did not take the whole response
+  bool reply(tcp::socket& s, const std::string& resp) {
+    boost::system::error_code ec;
+    rpc_metrics().bytes_out.inc(write_for(s, resp, ec));
+    return !ec;
+  }
+
+  static std::string http_429(const std::string& id, const char* why) {
+    boost::property_tree::ptree res, e;
+    res.put("jsonrpc", "2.0");
+    e.put("code", kOverloaded);
+    e.put("message", why);
+    res.add_child("error", e);
+    res.put("id", id);
+    std::string body = pt_dump(res);
+    std::ostringstream o;
+    o << "HTTP/1.1 429 Too Many Requests\r\n"
+      << "Content-Type: application/json\r\n"
+      << "Access-Control-Allow-Origin: *\r\n"
+      << "Retry-After: 1\r\n"
+      << "Content-Length: " << body.size() << "\r\n"
+      << "Connection: close\r\n\r\n"
+      << body;
+    return o.str();
+  }
+
+  // Content-Length of a header block, 0 if absent
+  static size_t content_length(const std::string& headers) {
     std::size_t cl = 0;
     std::istringstream hs(headers);
     std::string line;
@@ -70,60 +393,229 @@ struct RpcServer::Impl {
         if (key == "Content-Length" || key == "content-length") cl = static_cast<std::size_t>(std::stoul(val));
       }
     }
+    return cl;
+  }
+
+  static bool parse_http_request(const std::string& req, std::string& body_out) {
+    auto p = req.find("\r\n\r\n");
+    if (p == std::string::npos) return false;
+    std::string body = req.substr(p + 4);
+    std::size_t cl = content_length(req.substr(0, p + 4));
     if (cl > 0 && body.size() < cl) return false;
     if (cl > 0 && body.size() > cl) body.resize(cl);
     body_out.swap(body);
     return true;
   }
 
-  void handle_session(tcp::socket s) {
+  // Requests are read asynchronously on the io threads: a slow client holds
+  // a socket, not a thread.
+  void read_request(const SessionPtr& s) {
+    net::async_read_until(s->sock, s->buf, "\r\n\r\n", [this, s](const boost::system::error_code& ec, size_t hdr) {
+      if (ec) { QTC_DEBUG(RPC, "read failed: %s", ec.message().c_str()); return; }
+      size_t cl = 0;
+      try {
+        auto data = s->buf.data();
+        cl = content_length(std::string(net::buffers_begin(data), net::buffers_begin(data) + static_cast<std::ptrdiff_t>(hdr)));
+      } catch (const std::exception&) {
+        rpc_metrics().err_parse.inc(); reply(s->sock, http_400()); return;
+      }
+      if (cl > kMaxRequest - hdr) { rpc_metrics().err_parse.inc(); reply(s->sock, http_400()); return; }
+      size_t have = s->buf.size() - hdr;
+      if (have >= cl) { admit(s); return; }
+      net::async_read(s->sock, s->buf, net::transfer_exactly(cl - have),
+        [this, s](const boost::system::error_code& ec2, size_t) {
+          if (ec2) { QTC_DEBUG(RPC, "read failed: %s", ec2.message().c_str()); return; }
+          admit(s);
+        });
+    });
+  }
+
+  // io thread: parse, classify, then queue the call or refuse it right away
+  void admit(const SessionPtr& s) {
+    auto& m = rpc_metrics();
     try {
-      net::streambuf buf;
-      boost::system::error_code ec;
-      net::read_until(s, buf, "\r\n\r\n", ec);
-      if (ec && ec != net::error::eof) return;
-      std::istream is(&buf);
-      std::string req_headers((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
-
-      std::string body;
-      if (!parse_http_request(req_headers, body)) {
-        auto resp = http_400(); net::write(s, net::buffer(resp)); return;
+      auto data = s->buf.data();
+      std::string req(net::buffers_begin(data), net::buffers_end(data));
+      m.bytes_in.inc(req.size());
+      Cost cost = Cost::Cheap;
+      if (is_metrics_request(req)) {
+        s->metrics = true;
+      } else {
+        std::string body;
+        boost::property_tree::ptree call;
+        if (!parse_http_request(req, body) || !pt_parse(body, call)) {
+          m.err_parse.inc(); reply(s->sock, http_400()); return;
+        }
+        s->id = call.get<std::string>("id", "");
+        std::string method = call.get<std::string>("method", "");
+        auto params = call.get_child_optional("params");
+        if (params) s->params = *params;
+        {
+          std::lock_guard<std::mutex> lk(mu);
+          auto it = routes.find(method);
+          if (it != routes.end()) s->route = it->second;
+        }
+        QTC_DEBUG(RPC, "%s id=%s (%zu bytes)", method.c_str(), s->id.c_str(), body.size());
+        if (!s->route.h && !s->route.stream && !s->route.subscribe) {
+          m.err_method.inc();
+          boost::property_tree::ptree res, e;
+          res.put("jsonrpc", "2.0");
+          res.put("id", s->id);
+          e.put("code", -32601); e.put("message", "method not found");
+          res.add_child("error", e);
+          reply(s->sock, http_200(pt_dump(res)));
+          return;
+        }
+        cost = s->route.cost;
       }
-      boost::property_tree::ptree call;
-      if (!pt_parse(body, call)) {
-        auto resp = http_400(); net::write(s, net::buffer(resp)); return;
+
+      Lane& l = lanes[static_cast<int>(cost)];
+      if (!take_token(s->ip, cost)) {
+        l.rejected_rate->inc();
+        reply(s->sock, http_429(s->id, "rate limit exceeded"));
+        return;
+      }
+      // subscribing only registers the sink, so it is done right here
+      if (s->route.subscribe) {
+        subscribe(s);
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lk(l.mu);
+        if (l.q.size() >= l.limits.queue) {
+          l.rejected_busy->inc();
+        } else {
+          s->queued = Clock::now();
+          l.q.push_back(s);
+          l.depth->set(static_cast<double>(l.q.size()));
+          l.cv.notify_one();
+          return;
+        }
+      }
+      reply(s->sock, http_429(s->id, "server busy"));
+    } catch (const std::exception& e) {
+      m.err_exception.inc();
+      QTC_WARN(RPC, "admission failed: %s", e.what());
+    }
+  }
+
+  void subscribe(const SessionPtr& s) {
+    const Route& r = s->route;
+    r.calls->inc();
+    auto sink = std::make_shared<PushSink>(s, r.queue + 1); // + the response headers
+    bool ok = false;
+    try {
+      ok = r.subscribe(s->params, sink);
+    } catch (const std::invalid_argument& e) {
+      reply(s->sock, http_rpc_error(s->id, -32602, e.what()));
+      return;
+    }
+    if (!ok) {
+      lanes[static_cast<int>(r.cost)].rejected_busy->inc();
+      reply(s->sock, http_429(s->id, "too many subscribers"));
+      return;
+    }
+    sink->start();
+  }
+
+  bool take_token(const std::string& ip, Cost cost) {
+    const Limits& lim = lanes[static_cast<int>(cost)].limits;
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lk(bucket_mu);
+    if (buckets.size() >= kMaxClients && !buckets.count(ip)) evict_idle(now);
+    Bucket& b = buckets[ip][static_cast<int>(cost)];
+    if (b.tokens < 0) {
+      b.tokens = lim.burst;
+    } else {
+      double dt = std::chrono::duration<double>(now - b.last).count();
+      b.tokens = std::min(lim.burst, b.tokens + dt * lim.rate);
+    }
+    b.last = now;
+    if (b.tokens < 1.0) return false;
+    b.tokens -= 1.0;
+    return true;
+  }
+
+  // bucket_mu held. Drops clients whose buckets have all refilled; they
+  // would start full again anyway.
+  void evict_idle(Clock::time_point now) {
+    for (auto it = buckets.begin(); it != buckets.end();) {
+      bool idle = true;
+      for (int c = 0; c < kClasses && idle; ++c) {
+        const Bucket& b = it->second[c];
+        const Limits& lim = lanes[c].limits;
+        if (b.tokens >= 0 && b.tokens + std::chrono::duration<double>(now - b.last).count() * lim.rate < lim.burst)
+          idle = false;
       }
-      std::string id = call.get<std::string>("id", "");
-      std::string method = call.get<std::string>("method", "");
-      auto params = call.get_child_optional("params");
+      if (idle) it = buckets.erase(it); else ++it;
+    }
+  }
 
-      Handler h;
+  void work(Lane& l) {
+    for (;;) {
+      SessionPtr s;
       {
-        std::lock_guard<std::mutex> lk(mu);
-        auto it = routes.find(method);
-        if (it != routes.end()) h = it->second;
+        std::unique_lock<std::mutex> lk(l.mu);
+        l.cv.wait(lk, [this, &l]{ return !running.load() || !l.q.empty(); });
+        if (l.q.empty()) return;
+        s = std::move(l.q.front());
+        l.q.pop_front();
+        l.depth->set(static_cast<double>(l.q.size()));
+      }
+      l.wait->record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - s->queued).count()));
+      execute(*s);
+    }
+  }
+
+  void execute(Session& s) {
+    auto& m = rpc_metrics();
+    InflightGuard inflight(m.inflight);
+    try {
+      if (s.metrics) {
+        m.scrapes.inc();
+        reply(s.sock, http_metrics(Metrics::instance().render()));
+        return;
+      }
+      const Route& r = s.route;
+      r.calls->inc();
+      if (r.stream) {
+        ScopedTimer t(*r.latency);
+        stream(s.sock, r, s.params);
+        return;
       }
-      boost::property_tree::ptree p = params ? *params : boost::property_tree::ptree{};
       boost::property_tree::ptree res;
       res.put("jsonrpc", "2.0");
-      res.put("id", id);
-
-      if (!h) {
-        boost::property_tree::ptree e; e.put("code", -32601); e.put("message", "method not found");
-        res.add_child("error", e);
-        auto resp = http_200(pt_dump(res)); net::write(s, net::buffer(resp)); return;
+      res.put("id", s.id);
+      boost::property_tree::ptree result;
+      {
+        ScopedTimer t(*r.latency);
+        result = r.h(s.params);
       }
-
-      boost::property_tree::ptree result = h(p);
       res.add_child("result", result);
-      auto resp = http_200(pt_dump(res)); net::write(s, net::buffer(resp));
-    } catch (...) {}
+      reply(s.sock, http_200(pt_dump(res)));
+    } catch (const std::invalid_argument& e) {
+      // a handler rejecting its params
+      reply(s.sock, http_rpc_error(s.id, -32602, e.what()));
+    } catch (const std::exception& e) {
+      m.err_exception.inc();
+      QTC_WARN(RPC, "session failed: %s", e.what());
+      reply(s.sock, http_rpc_error(s.id, -32603, e.what()));
+    } catch (...) {
+      m.err_exception.inc();
+      QTC_WARN(RPC, "session failed: unknown exception");
+    }
   }
 
   void do_accept() {
-    auto sock = std::make_shared<tcp::socket>(ioc);
-    acc->async_accept(*sock, [this, sock](const boost::system::error_code& ec) {
-      if (!ec) std::thread([this, s = std::move(*sock)]() mutable { handle_session(std::move(s)); }).detach();
+    auto s = std::make_shared<Session>(ioc);
+    acc->async_accept(s->sock, [this, s](const boost::system::error_code& ec) {
+      if (!ec) {
+        boost::system::error_code rec;
+        auto ep = s->sock.remote_endpoint(rec);
+        s->ip = rec ? "unknown" : ep.address().to_string();
+        read_request(s);
+      }
       if (running.load()) do_accept();
     });
   }
@@ -135,9 +627,12 @@ struct RpcServer::Impl {
     boost::system::error_code ec;
     acc->open(ep.protocol(), ec);
     acc->set_option(net::socket_base::reuse_address(true), ec);
-    acc->bind(ep, ec);
-    acc->listen(net::socket_base::max_listen_connections, ec);
-    std::cout << "rpc listening on " << host << ":" << port << "\n";
+    if (!ec) acc->bind(ep, ec);
+    if (!ec) acc->listen(net::socket_base::max_listen_connections, ec);
+    if (ec) QTC_ERROR(RPC, "cannot listen on %s:%u: %s", host.c_str(), static_cast<unsigned>(port), ec.message().c_str());
+    else QTC_INFO(RPC, "listening on %s:%u", host.c_str(), static_cast<unsigned>(port));
+    for (auto& l : lanes)
+      for (size_t i = 0; i < std::max<size_t>(1, l.limits.workers); ++i) l.threads.emplace_back([this, &l]{ work(l); });
     do_accept();
     if (threads < 1) threads = 1;
     for (int i = 0; i < threads; ++i) workers.emplace_back([this]{ ioc.run(); });
@@ -149,12 +644,36 @@ struct RpcServer::Impl {
     ioc.stop();
     for (auto& t : workers) if (t.joinable()) t.join();
     workers.clear();
+    for (auto& l : lanes) {
+      {
+        std::lock_guard<std::mutex> lk(l.mu);
+        l.q.clear();
+      }
+      l.cv.notify_all();
+      for (auto& t : l.threads) if (t.joinable()) t.join();
+      l.threads.clear();
+    }
   }
 };
 
+RpcServer::Limits RpcServer::defaultLimits(Cost c) {
+  switch (c) {
+    case Cost::Cheap: return Limits{2, 1024, 1000, 2000};
+    case Cost::Normal: return Limits{2, 128, 100, 200};
+    case Cost::Heavy: break;
+  }
+  return Limits{1, 16, 10, 20};
+}
+
 RpcServer::RpcServer() : impl_(new Impl) {}
 RpcServer::~RpcServer() { impl_->stop(); }
-void RpcServer::add(const std::string& m, Handler h) { impl_->add(m, std::move(h)); }
+void RpcServer::add(const std::string& m, Handler h, Cost cost) { impl_->add(m, std::move(h), nullptr, cost); }
+void RpcServer::addStream(const std::string& m, StreamHandler h, Cost cost) { impl_->add(m, nullptr, std::move(h), cost); }
+void RpcServer::addSubscribe(const std::string& m, SubscribeHandler h, size_t queue, Cost cost) {
+  impl_->add(m, nullptr, nullptr, cost, std::move(h), queue);
+}
+void RpcServer::setLimits(Cost c, const Limits& l) { impl_->lanes[static_cast<int>(c)].limits = l; }
+void RpcServer::setWriteTimeout(std::chrono::milliseconds d) { impl_->write_timeout = d; }
 void RpcServer::start(const std::string& host, unsigned short port, int threads) { impl_->start(host, port, threads); }
 void RpcServer::stop() { impl_->stop(); }
 
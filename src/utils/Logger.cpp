@@ -0,0 +1,162 @@
+// src/utils/Logger.cpp
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <ctime>
+
+namespace QTC {
+
+namespace {
+
+constexpr size_t kMask = Logger::kCapacity - 1;
+static_assert((Logger::kCapacity & kMask) == 0, "ring capacity must be a power of two");
+
+constexpr const char* kLevelNames[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF" };
+constexpr const char* kTagNames[] = { "node", "chain", "p2p", "rpc", "zk", "vm" };
+static_assert(sizeof(kTagNames) / sizeof(kTagNames[0]) == static_cast<size_t>(LogTag::Count), "tag names");
+
+bool iequals(const std::string& a, const char* b) {
+  size_t i = 0;
+  for (; i < a.size() && b[i]; ++i)
+    if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+  return i == a.size() && !b[i];
+}
+
+}
+
+Logger& Logger::instance() {
+  static Logger l;
+  return l;
+}
+
+Logger::Logger() : ring_(new Record[kCapacity]), out_(stderr) {
+  for (size_t i = 0; i < kCapacity; ++i) ring_[i].seq.store(i, std::memory_order_relaxed);
+  for (auto& l : levels_) l.store(static_cast<uint8_t>(LogLevel::Info), std::memory_order_relaxed);
+  thread_ = std::thread([this]{ run(); });
+}
+
+Logger::~Logger() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+  if (out_ && out_ != stderr) std::fclose(out_);
+}
+
+bool Logger::open(const std::string& path) {
+  FILE* f = path.empty() ? stderr : std::fopen(path.c_str(), "a");
+  if (!f) return false;
+  flush();
+  std::lock_guard<std::mutex> lk(mu_);
+  if (out_ && out_ != stderr) std::fclose(out_);
+  out_ = f;
+  return true;
+}
+
+void Logger::setLevel(LogLevel l) {
+  for (auto& v : levels_) v.store(static_cast<uint8_t>(l), std::memory_order_relaxed);
+}
+
+void Logger::setLevel(LogTag t, LogLevel l) {
+  levels_[static_cast<size_t>(t)].store(static_cast<uint8_t>(l), std::memory_order_relaxed);
+}
+
+// Bounded MPMC ring (Vyukov): a slot is free for position p when its seq
+// equals p and readable when it equals p + 1. Producers claim positions with
+// a CAS on head_; only the drain thread advances tail_.
+void Logger::write(LogLevel l, LogTag t, const char* fmt, ...) {
+  uint64_t pos = head_.load(std::memory_order_relaxed);
+  Record* r;
+  for (;;) {
+    r = &ring_[pos & kMask];
+    uint64_t seq = r->seq.load(std::memory_order_acquire);
+    int64_t dif = static_cast<int64_t>(seq - pos);
+    if (dif == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (dif < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+  r->ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count());
+  r->level = l;
+  r->tag = t;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = std::vsnprintf(r->msg, kMsgLen, fmt, ap);
+  va_end(ap);
+  r->len = static_cast<uint16_t>(n < 0 ? 0 : std::min<size_t>(static_cast<size_t>(n), kMsgLen - 1));
+  r->seq.store(pos + 1, std::memory_order_release);
+}
+
+// mu_ held, drain thread only
+size_t Logger::drain() {
+  size_t n = 0;
+  for (;;) {
+    Record& r = ring_[tail_ & kMask];
+    if (r.seq.load(std::memory_order_acquire) != tail_ + 1) break;
+    std::time_t secs = static_cast<std::time_t>(r.ns / 1000000000ULL);
+    std::tm tm{};
+    gmtime_r(&secs, &tm);
+    char ts[32];
+    std::strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+    std::fprintf(out_, "%s.%06lluZ %-5s %-5s %.*s\n", ts,
+                 static_cast<unsigned long long>((r.ns / 1000ULL) % 1000000ULL),
+                 kLevelNames[static_cast<size_t>(r.level)], kTagNames[static_cast<size_t>(r.tag)],
+                 static_cast<int>(r.len), r.msg);
+    r.seq.store(tail_ + kCapacity, std::memory_order_release);
+    ++tail_;
+    ++n;
+  }
+  return n;
+}
+
+void Logger::run() {
+  std::unique_lock<std::mutex> lk(mu_);
+  for (;;) {
+    uint64_t req = flush_req_;
+    bool stopping = stop_;
+    if (drain()) std::fflush(out_);
+    flush_done_ = req;
+    drained_.notify_all();
+    if (stopping) return;
+    // producers never signal (that would put a lock on their path), so idle
+    // records wait at most one tick
+    cv_.wait_for(lk, std::chrono::milliseconds(10), [this]{ return stop_ || flush_req_ != flush_done_; });
+  }
+}
+
+void Logger::flush() {
+  std::unique_lock<std::mutex> lk(mu_);
+  if (stop_) return;
+  uint64_t req = ++flush_req_;
+  cv_.notify_all();
+  drained_.wait(lk, [this, req]{ return flush_done_ >= req || stop_; });
+}
+
+const char* Logger::name(LogLevel l) { return kLevelNames[static_cast<size_t>(l)]; }
+
+const char* Logger::name(LogTag t) {
+  return t < LogTag::Count ? kTagNames[static_cast<size_t>(t)] : "?";
+}
+
+bool Logger::parse(const std::string& s, LogLevel& out) {
+  for (size_t i = 0; i <= static_cast<size_t>(LogLevel::Off); ++i)
+    if (iequals(s, kLevelNames[i])) { out = static_cast<LogLevel>(i); return true; }
+  return false;
+}
+
+bool Logger::parse(const std::string& s, LogTag& out) {
+  for (size_t i = 0; i < static_cast<size_t>(LogTag::Count); ++i)
+    if (iequals(s, kTagNames[i])) { out = static_cast<LogTag>(i); return true; }
+  return false;
+}
+
+}
@@ -0,0 +1,152 @@
+// src/utils/Metrics.cpp
+#include "utils/Metrics.h"
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+namespace QTC {
+
+int Histogram::index(uint64_t v) {
+  if (v < 16) return static_cast<int>(v);
+  int e = 63 - __builtin_clzll(v);
+  int sub = static_cast<int>((v >> (e - kSubBits)) & ((1u << kSubBits) - 1));
+  return 16 + (e - 4) * (1 << kSubBits) + sub;
+}
+
+uint64_t Histogram::upperBound(int idx) {
+  if (idx < 16) return static_cast<uint64_t>(idx) + 1;
+  int e = 4 + (idx - 16) / (1 << kSubBits);
+  uint64_t sub = static_cast<uint64_t>((idx - 16) % (1 << kSubBits));
+  uint64_t base = 1ULL << kSubBits;
+  if (e == 63 && sub == base - 1) return UINT64_MAX;
+  return (base + sub + 1) << (e - kSubBits);
+}
+
+uint64_t Histogram::quantile(double q) const {
+  uint64_t total = count();
+  if (total == 0) return 0;
+  if (q < 0) q = 0;
+  if (q > 1) q = 1;
+  uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) return upperBound(i);
+  }
+  return UINT64_MAX;
+}
+
+Metrics& Metrics::instance() {
+  static Metrics m;
+  return m;
+}
+
+std::string Metrics::label(const std::string& key, const std::string& value) {
+  std::string out = key + "=\"";
+  for (char c : value) {
+    if (c == '\\' || c == '"') { out += '\\'; out += c; }
+    else if (c == '\n') out += "\\n";
+    else out += c;
+  }
+  out += '"';
+  return out;
+}
+
+Metrics::Family& Metrics::family(const std::string& name, const std::string& help, Type t) {
+  auto it = families_.find(name);
+  if (it == families_.end()) it = families_.emplace(name, Family{t, help, {}}).first;
+  else if (it->second.type != t) throw std::logic_error("metric " + name + " registered with another type");
+  return it->second;
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help, const std::string& labels) {
+  std::lock_guard<std::mutex> lk(mu_);
+  auto& f = family(name, help, Type::Counter);
+  auto& slot = f.children[labels];
+  if (!slot) { counters_.emplace_back(new Counter); slot = counters_.back().get(); }
+  return *static_cast<Counter*>(slot);
+}
+
+Gauge& Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+  std::lock_guard<std::mutex> lk(mu_);
+  auto& f = family(name, help, Type::Gauge);
+  auto& slot = f.children[labels];
+  if (!slot) { gauges_.emplace_back(new Gauge); slot = gauges_.back().get(); }
+  return *static_cast<Gauge*>(slot);
+}
+
+Histogram& Metrics::make_histogram(const std::string& name, const std::string& help, const std::string& labels,
+                                   double unit, int lo_exp, int hi_exp) {
+  std::lock_guard<std::mutex> lk(mu_);
+  auto& f = family(name, help, Type::Histogram);
+  auto& slot = f.children[labels];
+  if (!slot) { histograms_.emplace_back(new Histogram(unit, lo_exp, hi_exp)); slot = histograms_.back().get(); }
+  return *static_cast<Histogram*>(slot);
+}
+
+// 1us .. ~69s
+Histogram& Metrics::timer(const std::string& name, const std::string& help, const std::string& labels) {
+  return make_histogram(name, help, labels, 1e-9, 10, 36);
+}
+
+// 1 .. 64Mi
+Histogram& Metrics::histogram(const std::string& name, const std::string& help, const std::string& labels) {
+  return make_histogram(name, help, labels, 1.0, 0, 26);
+}
+
+static std::string fmt_double(double v) {
+  char b[64];
+  std::snprintf(b, sizeof(b), "%.9g", v);
+  return b;
+}
+
+static std::string with_labels(const std::string& labels, const std::string& extra = "") {
+  if (labels.empty() && extra.empty()) return "";
+  if (labels.empty()) return "{" + extra + "}";
+  if (extra.empty()) return "{" + labels + "}";
+  return "{" + labels + "," + extra + "}";
+}
+
+std::string Metrics::render() const {
+  std::ostringstream o;
+  std::lock_guard<std::mutex> lk(mu_);
+  for (const auto& kv : families_) {
+    const std::string& name = kv.first;
+    const Family& f = kv.second;
+    const char* type = f.type == Type::Counter ? "counter" : f.type == Type::Gauge ? "gauge" : "histogram";
+    o << "# HELP " << name << " " << f.help << "\n";
+    o << "# TYPE " << name << " " << type << "\n";
+    for (const auto& c : f.children) {
+      const std::string& labels = c.first;
+      if (f.type == Type::Counter) {
+        o << name << with_labels(labels) << " " << static_cast<const Counter*>(c.second)->value() << "\n";
+      } else if (f.type == Type::Gauge) {
+        o << name << with_labels(labels) << " " << fmt_double(static_cast<const Gauge*>(c.second)->value()) << "\n";
+      } else {
+        const Histogram* h = static_cast<const Histogram*>(c.second);
+        // cumulative counts at power-of-two bounds; bucket i covers values
+        // below upperBound(i), so every fine bucket below 2^k ends before it
+        int next = 0;
+        uint64_t cum = 0;
+        for (int k = h->lo_exp_; k <= h->hi_exp_; ++k) {
+          int limit = k <= 4 ? (1 << k) : 16 + (k - 4) * (1 << Histogram::kSubBits);
+          for (; next < limit; ++next) cum += h->buckets_[next].load(std::memory_order_relaxed);
+          o << name << "_bucket" << with_labels(labels, "le=\"" + fmt_double(std::ldexp(1.0, k) * h->unit_) + "\"")
+            << " " << cum << "\n";
+        }
+        // +Inf and _count come from the same bucket walk so the series stays
+        // monotonic while writers race with the scrape
+        for (; next < Histogram::kBuckets; ++next) cum += h->buckets_[next].load(std::memory_order_relaxed);
+        uint64_t count = cum;
+        o << name << "_bucket" << with_labels(labels, "le=\"+Inf\"") << " " << count << "\n";
+        o << name << "_sum" << with_labels(labels) << " " << fmt_double(static_cast<double>(h->sum()) * h->unit_) << "\n";
+        o << name << "_count" << with_labels(labels) << " " << count << "\n";
+      }
+    }
+  }
+  return o.str();
+}
+
+}
@@ -0,0 +1,73 @@
+// src/utils/VerifyCache.cpp
+#include "utils/VerifyCache.h"
+#include "crypto/Hash.h"
+#include "utils/ThreadPool.h"
+#include <algorithm>
+#include <future>
+#include <memory>
+
+namespace QTC {
+
+std::string VerifyCache::key(const std::string& item) {
+  Hash::Digest d = Hash::sha256(item);
+  return std::string(reinterpret_cast<const char*>(d.data()), d.size());
+}
+
+bool VerifyCache::contains(const std::string& k) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return set_.count(k) != 0;
+}
+
+void VerifyCache::insert(const std::string& k) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (!set_.insert(k).second) return;
+  order_.push_back(k);
+  while (order_.size() > max_) { set_.erase(order_.front()); order_.pop_front(); }
+}
+
+bool VerifyCache::verifyBatch(const std::vector<std::string>& keys, size_t chunk,
+                              const std::function<bool(size_t)>& check, size_t* bad) {
+  std::vector<size_t> todo;
+  for (size_t i = 0; i < keys.size(); ++i)
+    if (!contains(keys[i])) todo.push_back(i);
+  if (todo.empty()) return true;
+
+  // each chunk reports the first failing index in keys, or npos
+  auto run = [&check, &todo](size_t from, size_t to) {
+    for (size_t j = from; j < to; ++j) if (!check(todo[j])) return todo[j];
+    return std::string::npos;
+  };
+
+  if (chunk == 0) chunk = 1;
+  size_t first_bad = std::string::npos;
+  if (todo.size() < 2 * chunk) {
+    first_bad = run(0, todo.size());
+  } else {
+    auto& pool = verifier_pool();
+    size_t chunks = std::min(pool.size() * 4, (todo.size() + chunk - 1) / chunk);
+    size_t per = (todo.size() + chunks - 1) / chunks;
+    std::vector<std::future<size_t>> parts;
+    for (size_t from = 0; from < todo.size(); from += per) {
+      size_t to = std::min(todo.size(), from + per);
+      parts.push_back(pool.submit([&run, from, to]{ return run(from, to); }));
+    }
+    for (auto& f : parts) first_bad = std::min(first_bad, f.get());
+  }
+
+  if (first_bad != std::string::npos) {
+    if (bad) *bad = first_bad;
+    return false;
+  }
+  for (size_t i : todo) insert(keys[i]);
+  return true;
+}
+
+ThreadPool& verifier_pool() {
+  static std::mutex mu;
+  static std::unique_ptr<ThreadPool> pool;
+  std::lock_guard<std::mutex> lk(mu);
+  if (!pool) pool.reset(new ThreadPool());
+  return *pool;
+}
+
+}
@@ -0,0 +1,175 @@
+// src/vm/VM.cpp
+#include "vm/VM.h"
+#include <limits>
+
+// GCC/Clang: one indirect jump per handler (labels as values) instead of the
+// shared switch branch, so each opcode gets its own predictor entry.
+#if defined(__GNUC__) && !defined(QTC_VM_NO_THREADED)
+#define QTC_VM_THREADED 1
+#endif
+
+namespace QTC {
+
+namespace {
+
+const uint32_t kGas[] = {
+#define QTC_VM_GAS(name, gas) gas,
+  QTC_VM_OPS(QTC_VM_GAS)
+#undef QTC_VM_GAS
+};
+
+const char* const kNames[] = {
+#define QTC_VM_NAME(name, gas) #name,
+  QTC_VM_OPS(QTC_VM_NAME)
+#undef QTC_VM_NAME
+};
+
+bool is_jump(Op op) { return op == Op::Jmp || op == Op::Jz || op == Op::Jnz; }
+
+}
+
+std::unique_ptr<Program> Program::verify(std::vector<Instr> code, std::string* err) {
+  auto fail = [err](const std::string& why) {
+    if (err) *err = why;
+    return std::unique_ptr<Program>();
+  };
+  if (code.empty()) return fail("empty program");
+  if (code.size() > VM::kMaxCode) return fail("program too large");
+  for (size_t i = 0; i < code.size(); ++i) {
+    const Instr& in = code[i];
+    std::string at = " at " + std::to_string(i);
+    if (in.op >= static_cast<uint8_t>(Op::Count)) return fail("unknown opcode" + at);
+    if (in.a >= VM::kRegs || in.b >= VM::kRegs || in.c >= VM::kRegs) return fail("bad register" + at);
+    if (is_jump(static_cast<Op>(in.op)) && (in.imm < 0 || static_cast<size_t>(in.imm) >= code.size()))
+      return fail("jump out of range" + at);
+  }
+  Op last = static_cast<Op>(code.back().op);
+  if (last != Op::Halt && last != Op::Ret && last != Op::Jmp) return fail("program can fall off the end");
+  return std::unique_ptr<Program>(new Program(std::move(code)));
+}
+
+bool Program::decode(const std::string& bytes, std::vector<Instr>& out) {
+  if (bytes.size() % 8) return false;
+  out.resize(bytes.size() / 8);
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(bytes.data());
+  for (auto& in : out) {
+    in.op = p[0]; in.a = p[1]; in.b = p[2]; in.c = p[3];
+    uint32_t u = uint32_t(p[4]) | (uint32_t(p[5]) << 8) | (uint32_t(p[6]) << 16) | (uint32_t(p[7]) << 24);
+    in.imm = static_cast<int32_t>(u);
+    p += 8;
+  }
+  return true;
+}
+
+std::string Program::encode(const std::vector<Instr>& code) {
+  std::string s(code.size() * 8, '\0');
+  for (size_t i = 0; i < code.size(); ++i) {
+    const Instr& in = code[i];
+    uint32_t u = static_cast<uint32_t>(in.imm);
+    char* p = &s[8 * i];
+    p[0] = static_cast<char>(in.op); p[1] = static_cast<char>(in.a);
+    p[2] = static_cast<char>(in.b); p[3] = static_cast<char>(in.c);
+    for (int k = 0; k < 4; ++k) p[4 + k] = static_cast<char>((u >> (8 * k)) & 0xff);
+  }
+  return s;
+}
+
+const char* VM::name(Op op) {
+  return op < Op::Count ? kNames[static_cast<size_t>(op)] : "?";
+}
+
+uint32_t VM::gas(Op op) {
+  return op < Op::Count ? kGas[static_cast<size_t>(op)] : 0;
+}
+
+#if QTC_VM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+VM::Result VM::run(const Program& p, Storage& s, uint64_t gasLimit, const uint64_t* args, size_t nargs) {
+  uint64_t r[kRegs] = {};
+  for (size_t i = 0; i < nargs && i < kRegs; ++i) r[i] = args[i];
+
+  const int64_t limit = gasLimit > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())
+    ? std::numeric_limits<int64_t>::max() : static_cast<int64_t>(gasLimit);
+  int64_t gas = limit;
+  const Instr* const base = p.code().data();
+  const Instr* ip = base;
+  uint64_t value = 0;
+
+  // Program::verify guarantees valid opcodes/registers/targets and that the
+  // last instruction never falls through, so nothing below is range checked.
+#if QTC_VM_THREADED
+  static const void* const kLabels[] = {
+#define QTC_VM_LABEL(name, g) &&op_##name,
+    QTC_VM_OPS(QTC_VM_LABEL)
+#undef QTC_VM_LABEL
+  };
+#define VM_DISPATCH() do { if ((gas -= kGas[ip->op]) < 0) goto out_of_gas; goto *kLabels[ip->op]; } while (0)
+#define VM_CASE(name) op_##name:
+#else
+#define VM_DISPATCH() goto dispatch
+#define VM_CASE(name) case Op::name:
+#endif
+#define VM_NEXT() do { ++ip; VM_DISPATCH(); } while (0)
+#define VM_JUMP() do { ip = base + ip->imm; VM_DISPATCH(); } while (0)
+#define RA r[ip->a]
+#define RB r[ip->b]
+#define RC r[ip->c]
+
+#if QTC_VM_THREADED
+  VM_DISPATCH();
+  {
+#else
+dispatch:
+  if ((gas -= kGas[ip->op]) < 0) goto out_of_gas;
+  switch (static_cast<Op>(ip->op)) {
+#endif
+  VM_CASE(Halt)   value = r[0]; goto done;
+  VM_CASE(Ret)    value = RA; goto done;
+  VM_CASE(LoadI)  RA = static_cast<uint64_t>(static_cast<int64_t>(ip->imm)); VM_NEXT();
+  VM_CASE(LoadHi) RA = (RA & 0xffffffffULL) | (static_cast<uint64_t>(static_cast<uint32_t>(ip->imm)) << 32); VM_NEXT();
+  VM_CASE(Mov)    RA = RB; VM_NEXT();
+  VM_CASE(Add)    RA = RB + RC; VM_NEXT();
+  VM_CASE(AddI)   RA = RB + static_cast<uint64_t>(static_cast<int64_t>(ip->imm)); VM_NEXT();
+  VM_CASE(Sub)    RA = RB - RC; VM_NEXT();
+  VM_CASE(Mul)    RA = RB * RC; VM_NEXT();
+  VM_CASE(Div)    RA = RC ? RB / RC : 0; VM_NEXT();
+  VM_CASE(Mod)    RA = RC ? RB % RC : 0; VM_NEXT();
+  VM_CASE(And)    RA = RB & RC; VM_NEXT();
+  VM_CASE(Or)     RA = RB | RC; VM_NEXT();
+  VM_CASE(Xor)    RA = RB ^ RC; VM_NEXT();
+  VM_CASE(Shl)    RA = RB << (RC & 63); VM_NEXT();
+  VM_CASE(Shr)    RA = RB >> (RC & 63); VM_NEXT();
+  VM_CASE(Eq)     RA = RB == RC; VM_NEXT();
+  VM_CASE(Lt)     RA = RB < RC; VM_NEXT();
+  VM_CASE(Jmp)    VM_JUMP();
+  VM_CASE(Jz)     if (RA == 0) VM_JUMP(); VM_NEXT();
+  VM_CASE(Jnz)    if (RA != 0) VM_JUMP(); VM_NEXT();
+  VM_CASE(SLoad)  RA = s.load(RB); VM_NEXT();
+  VM_CASE(SStore) s.store(RA, RB); VM_NEXT();
+#if !QTC_VM_THREADED
+  case Op::Count: break;
+#endif
+  }
+
+#undef RC
+#undef RB
+#undef RA
+#undef VM_JUMP
+#undef VM_NEXT
+#undef VM_CASE
+#undef VM_DISPATCH
+
+out_of_gas:
+  return Result{Status::OutOfGas, 0, static_cast<uint64_t>(limit)};
+done:
+  return Result{Status::Ok, value, static_cast<uint64_t>(limit - gas)};
+}
+
+#if QTC_VM_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+}
@@ -1,32 +1,220 @@
 // src/wallet/Wallet.cpp
 #include "wallet/Wallet.h"
-#include <openssl/sha.h>
+#include "blockchain/Block.h"
+#include "blockchain/Blockchain.h"
+#include "blockchain/Transaction.h"
+#include "utils/Logger.h"
+#include "utils/Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <sstream>
-#include <iomanip>
-#include <ctime>
-#include <random>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace QTC {
-static std::vector<std::string> g_addrs;
-
-static std::string sha256(const std::string& s) {
-  unsigned char h[SHA256_DIGEST_LENGTH];
-  SHA256(reinterpret_cast<const unsigned char*>(s.data()), s.size(), h);
-  std::ostringstream o;
-  for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i)
-    o << std::hex << std::setw(2) << std::setfill('0') << (int)h[i];
-  return o.str();
-}
-
-std::string Wallet::Create() {
-  std::mt19937_64 rng(static_cast<uint64_t>(std::time(nullptr)));
-  std::ostringstream seed; seed << "k" << rng();
-  std::string h = sha256(seed.str());
-  std::string addr = "QTC" + h.substr(0, 40);
-  g_addrs.push_back(addr);
+
+namespace {
+struct WalletMetrics {
+  Gauge& addresses = Metrics::instance().gauge("qtc_wallet_addresses", "Addresses with a key in the wallet");
+  Counter& rescans = Metrics::instance().counter("qtc_wallet_rescans_total",
+                                                 "Wallet balances reloaded from chain state instead of followed");
+};
+WalletMetrics& wallet_metrics() { static WalletMetrics m; return m; }
+
+bool is_hex(const std::string& s, size_t len) {
+  if (s.size() != len) return false;
+  for (char c : s)
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+  return true;
+}
+
+// a stored pair must still sign for its own public key
+bool key_matches(const Signature::KeyPair& kp) {
+  static const std::string probe = "qtc-wallet-key-check";
+  std::string sig = Signature::sign(kp.priv, probe);
+  return !sig.empty() && Signature::verify(kp.pub, probe, sig);
+}
+}
+
+bool Wallet::open(const std::string& dir) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (dir.empty()) { path_.clear(); return true; }
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  path_ = dir + "/keys";
+  std::ifstream in(path_);
+  if (!in) return !std::filesystem::exists(path_, ec);
+  std::string ln;
+  size_t lineNo = 0;
+  while (std::getline(in, ln)) {
+    ++lineNo;
+    if (ln.empty()) continue;
+    std::istringstream s(ln);
+    Signature::KeyPair kp;
+    if (!(s >> kp.priv >> kp.pub) || !is_hex(kp.priv, 64) || !is_hex(kp.pub, 64) || !key_matches(kp)) {
+      QTC_ERROR(Node, "wallet %s: bad key on line %zu", path_.c_str(), lineNo);
+      return false;
+    }
+    std::string addr = Signature::address(kp.pub);
+    if (keys_.count(addr)) continue;
+    keys_[addr].key = kp;
+    order_.push_back(addr);
+  }
+  if (in.bad()) return false;
+  wallet_metrics().addresses.set(static_cast<double>(order_.size()));
+  rescan();
+  return true;
+}
+
+void Wallet::attach(Blockchain& chain) {
+  chain.addBlockListener([this](const Block& b) { onBlock(b); });
+  std::lock_guard<std::mutex> lk(mu_);
+  chain_ = &chain;
+  rescan();
+}
+
+// mu_ held. Appends the key and syncs it to disk. The file is created
+// owner-only; keys are never added to one that others can read.
+bool Wallet::persist(const Signature::KeyPair& kp) {
+  if (path_.empty()) return true;
+  int fd = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) return false;
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || (st.st_mode & 077) != 0) {
+    QTC_ERROR(Node, "wallet %s: readable by group or others; refusing to add keys", path_.c_str());
+    ::close(fd);
+    return false;
+  }
+  FILE* f = ::fdopen(fd, "a");
+  if (!f) { ::close(fd); return false; }
+  bool ok = std::fprintf(f, "%s %s\n", kp.priv.c_str(), kp.pub.c_str()) > 0 && std::fflush(f) == 0 &&
+            ::fsync(fileno(f)) == 0;
+  return std::fclose(f) == 0 && ok;
+}
+
+std::string Wallet::create() {
+  Signature::KeyPair kp = Signature::generate();
+  std::string addr = Signature::address(kp.pub);
+  if (addr.empty()) return "";
+  std::lock_guard<std::mutex> lk(mu_);
+  if (!persist(kp)) {
+    QTC_ERROR(Node, "wallet %s: could not save new key", path_.c_str());
+    return "";
+  }
+  keys_[addr].key = kp;
+  order_.push_back(addr);
+  wallet_metrics().addresses.set(static_cast<double>(order_.size()));
   return addr;
 }
 
-const std::vector<std::string>& Wallet::All() { return g_addrs; }
+std::vector<std::string> Wallet::addresses() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return order_;
+}
+
+bool Wallet::owns(const std::string& address) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return keys_.count(address) != 0;
+}
+
+bool Wallet::sign(Transaction& tx) const {
+  Signature::KeyPair kp;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = keys_.find(tx.getFrom());
+    if (it == keys_.end()) return false;
+    kp = it->second.key;
+  }
+  tx.sign(kp.priv, kp.pub);
+  return !tx.getSignature().empty();
+}
+
+uint64_t Wallet::balance() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return total_;
+}
+
+uint64_t Wallet::balance(const std::string& address) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  auto it = keys_.find(address);
+  return it != keys_.end() ? it->second.balance : 0;
+}
+
+std::string Wallet::spendable(uint64_t need) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (total_ < need) return "";
+  // the chain admits a tx against the confirmed balance alone, so a second
+  // send from the same address would overdraw it once both are mined
+  std::vector<uint64_t> held;
+  if (chain_) chain_->getPendingSpends(order_, held);
+  for (size_t i = 0; i < order_.size(); ++i) {
+    uint64_t bal = keys_.at(order_[i]).balance;
+    uint64_t out = i < held.size() ? held[i] : 0;
+    if (bal >= out && bal - out >= need) return order_[i];
+  }
+  return "";
+}
+
+std::vector<Wallet::Tx> Wallet::transactions(size_t max) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  size_t n = std::min(max, history_.size());
+  return std::vector<Tx>(history_.begin(), history_.begin() + static_cast<std::ptrdiff_t>(n));
+}
+
+// Same arithmetic as the chain's transfer, applied to the sides we own.
+void Wallet::onBlock(const Block& b) {
+  std::lock_guard<std::mutex> lk(mu_);
+  int64_t idx = static_cast<int64_t>(b.getIndex());
+  if (idx <= synced_) return; // already in a rescan
+  // a gap means state arrived without blocks (snapshot sync) or a later
+  // notification overtook this one
+  if (idx != synced_ + 1) { rescan(); return; }
+  synced_ = idx;
+  if (keys_.empty()) return;
+  for (const auto& tx : b.getTransactions()) {
+    bool mine = false;
+    if (tx.getFrom() != "COINBASE") {
+      auto f = keys_.find(tx.getFrom());
+      if (f != keys_.end()) {
+        uint64_t& bal = f->second.balance;
+        uint64_t spend = tx.getAmount() + tx.getFee();
+        uint64_t left = bal >= spend ? bal - spend : 0;
+        total_ -= bal - left;
+        bal = left;
+        mine = true;
+      }
+    }
+    auto t = keys_.find(tx.getTo());
+    if (t != keys_.end()) {
+      uint64_t& bal = t->second.balance;
+      uint64_t addv = bal + tx.getAmount();
+      if (addv < bal) addv = UINT64_MAX;
+      total_ += addv - bal;
+      bal = addv;
+      mine = true;
+    }
+    if (!mine) continue;
+    history_.push_front(Tx{tx.getId(), static_cast<uint64_t>(idx), tx.getFrom(), tx.getTo(), tx.getAmount(),
+                           tx.getFee()});
+    if (history_.size() > kMaxHistory) history_.pop_back();
+  }
+}
+
+// mu_ held. Reloads every owned balance from the chain in one read.
+void Wallet::rescan() {
+  if (!chain_) return;
+  std::vector<uint64_t> bals;
+  uint64_t count = chain_->getBalances(order_, bals);
+  total_ = 0;
+  for (size_t i = 0; i < order_.size(); ++i) {
+    keys_[order_[i]].balance = bals[i];
+    total_ += bals[i];
+  }
+  synced_ = static_cast<int64_t>(count) - 1;
+  wallet_metrics().rescans.inc();
+}
 
 }
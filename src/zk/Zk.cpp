@@ -1,24 +1,184 @@
 #include "zk/Zk.h"
-#include <iostream>
+#include "crypto/Hash.h"
+#include "utils/Logger.h"
+#include "utils/ThreadPool.h"
+#include "utils/VerifyCache.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
 
 #if defined(QTC_ENABLE_ZK) && defined(HAVE_LIBSNARK)
 #include <libsnark/common/default_types/r1cs_ppzksnark_pp.hpp>
 #include <libsnark/relations/constraint_satisfaction_problems/r1cs/examples/r1cs_examples.hpp>
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using ppT = libsnark::default_r1cs_ppzksnark_pp;
+using FieldT = libff::Fr<ppT>;
 #endif
 
 namespace QTC {
 
+namespace {
+std::mutex g_mu;
+std::unique_ptr<ThreadPool> g_pool;
+std::string g_key_dir;
+
+ThreadPool& prover_pool() {
+  std::lock_guard<std::mutex> lk(g_mu);
+  if (!g_pool) g_pool.reset(new ThreadPool());
+  return *g_pool;
+}
+
+VerifyCache g_verified(100000);
+
+// proofs per verifier task; below two chunks the batch is checked inline
+constexpr size_t kVerifyChunk = 16;
+
+#if defined(QTC_ENABLE_ZK) && defined(HAVE_LIBSNARK)
+// Keys for the transfer circuit. Generated once per key directory and shared
+// by every prover thread; libsnark's prover/verifier only read them.
+struct TransferKeys {
+  libsnark::r1cs_ppzksnark_proving_key<ppT> pk;
+  libsnark::r1cs_ppzksnark_verification_key<ppT> vk;
+  libsnark::r1cs_ppzksnark_processed_verification_key<ppT> pvk;
+  libsnark::r1cs_primary_input<FieldT> primary;
+  libsnark::r1cs_auxiliary_input<FieldT> auxiliary;
+};
+
+std::once_flag g_keys_once;
+std::unique_ptr<TransferKeys> g_keys;
+
+// read-only mapping of a whole file, exposed as an istream
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) { data_ = static_cast<char*>(p); size_ = static_cast<size_t>(st.st_size); }
+    }
+    ::close(fd);
+    if (data_) buf_.reset(new Buf(data_, size_));
+  }
+  ~MappedFile() { if (data_) ::munmap(data_, size_); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool ok() const { return data_ != nullptr; }
+  std::streambuf* rdbuf() { return buf_.get(); }
+
+private:
+  struct Buf : std::streambuf {
+    Buf(char* p, size_t n) { setg(p, p, p + n); }
+  };
+  char* data_{nullptr};
+  size_t size_{0};
+  std::unique_ptr<Buf> buf_;
+};
+
+std::string key_path(const std::string& dir, const char* name) { return dir + "/transfer." + name; }
+
+bool load_keys(const std::string& dir, TransferKeys& k) {
+  MappedFile pkf(key_path(dir, "pk")), vkf(key_path(dir, "vk")), wf(key_path(dir, "witness"));
+  if (!pkf.ok() || !vkf.ok() || !wf.ok()) return false;
+  std::istream pk(pkf.rdbuf()), vk(vkf.rdbuf()), w(wf.rdbuf());
+  pk >> k.pk;
+  vk >> k.vk;
+  w >> k.primary;
+  w >> k.auxiliary;
+  return !pk.fail() && !vk.fail() && !w.fail();
+}
+
+template <class T>
+bool write_atomic(const std::string& path, const T& v) {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream o(tmp, std::ios::binary | std::ios::trunc);
+    if (!o) return false;
+    o << v;
+    if (!o) return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void save_keys(const std::string& dir, const TransferKeys& k) {
+  std::ostringstream w;
+  w << k.primary;
+  w << k.auxiliary;
+  if (!write_atomic(key_path(dir, "pk"), k.pk) ||
+      !write_atomic(key_path(dir, "vk"), k.vk) ||
+      !write_atomic(key_path(dir, "witness"), w.str()))
+    QTC_WARN(Zk, "could not persist keys to %s", dir.c_str());
+}
+
+const TransferKeys& transfer_keys() {
+  std::call_once(g_keys_once, []{
+    ppT::init_public_params();
+    std::string dir;
+    { std::lock_guard<std::mutex> lk(g_mu); dir = g_key_dir; }
+    std::unique_ptr<TransferKeys> k(new TransferKeys);
+    if (dir.empty() || !load_keys(dir, *k)) {
+      k.reset(new TransferKeys);
+      auto example = libsnark::generate_r1cs_example_with_field_input<FieldT>(100, 10);
+      auto keypair = libsnark::r1cs_ppzksnark_generator<ppT>(example.constraint_system);
+      k->pk = std::move(keypair.pk);
+      k->vk = std::move(keypair.vk);
+      k->primary = std::move(example.primary_input);
+      k->auxiliary = std::move(example.auxiliary_input);
+      if (!dir.empty()) save_keys(dir, *k);
+    }
+    k->pvk = libsnark::r1cs_ppzksnark_verifier_process_vk<ppT>(k->vk);
+    g_keys = std::move(k);
+  });
+  return *g_keys;
+}
+
+#endif
+
+bool verify_one(const std::string& proof) {
+#if defined(QTC_ENABLE_ZK) && defined(HAVE_LIBSNARK)
+  std::string raw;
+  if (proof.empty() || !Hash::fromHex(proof, raw)) return false;
+  libsnark::r1cs_ppzksnark_proof<ppT> prf;
+  std::istringstream i(raw);
+  i >> prf;
+  if (i.fail()) return false;
+  const auto& k = transfer_keys();
+  return libsnark::r1cs_ppzksnark_online_verifier_strong_IC<ppT>(k.pvk, k.primary, prf);
+#else
+  return proof == "dummy_proof" || proof == "groth16_proof_example";
+#endif
+}
+}
+
+bool Zk::setup(const std::string& keyDir, size_t threads) {
+  {
+    std::lock_guard<std::mutex> lk(g_mu);
+    g_key_dir = keyDir;
+    if (!g_pool) g_pool.reset(new ThreadPool(threads));
+  }
+#if defined(QTC_ENABLE_ZK) && defined(HAVE_LIBSNARK)
+  transfer_keys();
+#endif
+  return true;
+}
+
 bool Zk::prove_transfer(const std::string& note, std::string& proof) {
 #if defined(QTC_ENABLE_ZK) && defined(HAVE_LIBSNARK)
-  static bool init = (ppT::init_public_params(), true);
-  (void)init;
-  auto example = libsnark::generate_r1cs_example_with_field_input<ppT::Fp_type>(100, 10);
-  auto keypair = libsnark::r1cs_ppzksnark_generator<ppT>(example.constraint_system);
-  auto prf = libsnark::r1cs_ppzksnark_prover<ppT>(keypair.pk, example.primary_input, example.auxiliary_input);
-  auto ok = libsnark::r1cs_ppzksnark_verifier_strong_IC<ppT>(keypair.vk, example.primary_input, prf);
-  if (!ok) return false;
-  proof = "groth16_proof_example";
+  const auto& k = transfer_keys();
+  auto prf = libsnark::r1cs_ppzksnark_prover<ppT>(k.pk, k.primary, k.auxiliary);
+  std::ostringstream o;
+  o << prf;
+  std::string raw = o.str();
+  proof = Hash::toHex(reinterpret_cast<const uint8_t*>(raw.data()), raw.size());
   (void)note;
   return true;
 #else
@@ -28,12 +188,27 @@ bool Zk::prove_transfer(const std::string& note, std::string& proof) {
 #endif
 }
 
+std::future<std::string> Zk::prove_transfer_async(const std::string& note) {
+  return prover_pool().submit([note]{
+    std::string proof;
+    if (!prove_transfer(note, proof)) proof.clear();
+    return proof;
+  });
+}
+
 bool Zk::verify_transfer(const std::string& proof) {
-#if defined(QTC_ENABLE_ZK) && defined(HAVE_LIBSNARK)
-  return !proof.empty(); // placeholder
-#else
-  return proof == "dummy_proof" || proof == "groth16_proof_example";
-#endif
+  std::string k = VerifyCache::key(proof);
+  if (g_verified.contains(k)) return true;
+  if (!verify_one(proof)) return false;
+  g_verified.insert(k);
+  return true;
+}
+
+bool Zk::verify_transfer_batch(const std::vector<std::string>& proofs, size_t* bad) {
+  // proofs already checked at mempool admission are skipped
+  std::vector<std::string> keys(proofs.size());
+  for (size_t i = 0; i < proofs.size(); ++i) keys[i] = VerifyCache::key(proofs[i]);
+  return g_verified.verifyBatch(keys, kVerifyChunk, [&proofs](size_t i) { return verify_one(proofs[i]); }, bad);
 }
 
 } // namespace QTC
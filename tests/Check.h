@@ -0,0 +1,24 @@
+// tests/Check.h
+// Minimal checks for the test executables: a failed CHECK prints where and
+// what, and check_result() turns the count into the exit code.
+#pragma once
+#include <cstdio>
+
+namespace QTC {
+namespace test {
+inline int& failures() { static int n = 0; return n; }
+
+inline int check_result() {
+  if (failures()) std::fprintf(stderr, "%d check(s) failed\n", failures());
+  return failures() ? 1 : 0;
+}
+}
+}
+
+#define CHECK(c)                                                                  \
+  do {                                                                            \
+    if (!(c)) {                                                                   \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #c); \
+      ++QTC::test::failures();                                                    \
+    }                                                                             \
+  } while (0)
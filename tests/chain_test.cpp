@@ -0,0 +1,202 @@
+// tests/chain_test.cpp
+// Consensus checks on data received from peers. Prints each failed check
+// and exits non-zero if there was one.
+#include "blockchain/Block.h"
+#include "blockchain/Blockchain.h"
+#include "blockchain/ChainVerifier.h"
+#include "blockchain/Snapshot.h"
+#include "blockchain/Transaction.h"
+#include "crypto/Signature.h"
+#include "Check.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A funded sender on `chain` and a signed transfer from it, not yet submitted.
+struct Transfer {
+  QTC::Signature::KeyPair key;
+  std::string from;
+  std::unique_ptr<QTC::Transaction> tx;
+};
+
+Transfer make_transfer(QTC::Blockchain& chain) {
+  Transfer t;
+  t.key = QTC::Signature::generate();
+  t.from = QTC::Signature::address(t.key.pub);
+  chain.minePendingTransactions(t.from);
+  std::string to = QTC::Signature::address(QTC::Signature::generate().pub);
+  t.tx.reset(new QTC::Transaction(t.from, to, 5, 1));
+  t.tx->sign(t.key.priv, t.key.pub);
+  return t;
+}
+
+std::unique_ptr<QTC::Transaction> reparse(const boost::property_tree::ptree& p) {
+  return QTC::Transaction::fromPtree(p);
+}
+
+// the id on the wire is kept, and one that does not match the fields fails
+void tampered_txid() {
+  QTC::Blockchain chain(0);
+  Transfer t = make_transfer(chain);
+  auto wire = t.tx->toPtree();
+
+  CHECK(reparse(wire)->hasValidId());
+
+  auto id = wire;
+  id.put("id", std::string(64, 'a'));
+  CHECK(!reparse(id)->hasValidId());
+  CHECK(!chain.addTransaction(*reparse(id)));
+
+  // id and signature of the original over a larger amount
+  auto amount = wire;
+  amount.put("amount", 500);
+  CHECK(reparse(amount)->getId() == t.tx->getId());
+  CHECK(!reparse(amount)->hasValidId());
+  CHECK(!chain.addTransaction(*reparse(amount)));
+
+  CHECK(chain.addTransaction(*reparse(wire)));
+}
+
+// a peer block carrying a tampered tx is refused; the original connects
+void tampered_txid_in_block() {
+  QTC::Blockchain chain(0), peer(0);
+  Transfer t = make_transfer(chain);
+  CHECK(chain.addTransaction(*t.tx));
+  chain.minePendingTransactions(t.from);
+  for (uint64_t k = 1; k + 1 < chain.getBlockCount(); ++k) CHECK(peer.addBlockFromPeer(*chain.getBlockCopyByIndex(k)));
+
+  auto good = chain.getBlockCopyByIndex(chain.getBlockCount() - 1)->toPtree();
+  for (const char* field : {"id", "amount"}) {
+    auto bad = good;
+    for (auto& tx : bad.get_child("tx")) {
+      if (tx.second.get<std::string>("from") != t.from) continue;
+      if (std::string(field) == "id") tx.second.put("id", std::string(64, 'a'));
+      else tx.second.put("amount", 500);
+    }
+    CHECK(!peer.addBlockFromPeer(*QTC::Block::fromPtree(bad)));
+  }
+  CHECK(peer.addBlockFromPeer(*QTC::Block::fromPtree(good)));
+  CHECK(peer.getBalance(t.from) == chain.getBalance(t.from));
+}
+
+// peer blocks must carry the chain's difficulty and the work it asks for
+void peer_block_difficulty() {
+  QTC::Blockchain chain(1);
+  auto next = [&chain](uint32_t diff) {
+    QTC::Block b(static_cast<uint32_t>(chain.getBlockCount()), chain.getTipHash(), diff);
+    b.mine();
+    return b;
+  };
+  CHECK(!chain.addBlockFromPeer(next(0)));
+  CHECK(!chain.addBlockFromPeer(next(2)));
+
+  auto forged = next(1).toPtree();
+  forged.put("nonce", forged.get<uint64_t>("nonce") + 1);
+  CHECK(!chain.addBlockFromPeer(*QTC::Block::fromPtree(forged)));
+
+  CHECK(chain.addBlockFromPeer(next(1)));
+  auto r = QTC::ChainVerifier::run(chain, QTC::ChainVerifier::Options{});
+  CHECK(r.ok && r.checked == 2);
+}
+
+
+// a peer block takes the txs it confirms out of the mempool
+void peer_block_clears_mempool() {
+  QTC::Blockchain chain(0), peer(0);
+  Transfer t = make_transfer(chain);
+  CHECK(peer.addBlockFromPeer(*chain.getBlockCopyByIndex(1)));
+  CHECK(peer.addTransaction(*t.tx));
+  std::vector<uint64_t> held;
+  peer.getPendingSpends({t.from}, held);
+  CHECK(held.size() == 1 && held[0] == 6);
+
+  CHECK(chain.addTransaction(*t.tx));
+  chain.minePendingTransactions(t.from);
+  CHECK(peer.addBlockFromPeer(*chain.getBlockCopyByIndex(2)));
+  CHECK(!peer.getPendingById(t.tx->getId()));
+  peer.getPendingSpends({t.from}, held);
+  CHECK(held.size() == 1 && held[0] == 0);
+}
+
+// Blocks applied through the execution pool leave the same balances and
+// minted supply as applied serially: a block wide enough for the layered
+// path, with self-transfers and overdrafts clamped to 0, then one where a
+// hot account chains every tx and the pool falls back to serial.
+void parallel_balances() {
+  QTC::Blockchain par(0), ser(0);
+  par.setExecutionThreads(4);
+  ser.setExecutionThreads(1);
+  // a snapshot per block commits to every balance and to the minted supply
+  par.setSnapshotInterval(1);
+  ser.setSnapshotInterval(1);
+
+  const size_t k = 100;
+  std::vector<QTC::Signature::KeyPair> keys;
+  std::vector<std::string> senders, sinks, all;
+  for (size_t i = 0; i < k; ++i) {
+    keys.push_back(QTC::Signature::generate());
+    senders.push_back(QTC::Signature::address(keys.back().pub));
+    sinks.push_back(QTC::Signature::address(QTC::Signature::generate().pub));
+  }
+  std::string hot = QTC::Signature::address(QTC::Signature::generate().pub);
+  std::string miner = QTC::Signature::address(QTC::Signature::generate().pub);
+  all = senders;
+  all.insert(all.end(), sinks.begin(), sinks.end());
+  all.push_back(hot);
+  all.push_back(miner);
+
+  auto transfer = [&keys, &senders](size_t i, const std::string& to, uint64_t amount) {
+    QTC::Transaction tx(senders[i], to, amount, 1);
+    tx.sign(keys[i].priv, keys[i].pub);
+    return tx;
+  };
+  auto connect = [&par, &ser](QTC::Block& b) {
+    b.mine();
+    CHECK(par.addBlockFromPeer(b));
+    CHECK(ser.addBlockFromPeer(b));
+    auto sp = par.latestSnapshot(), ss = ser.latestSnapshot();
+    CHECK(sp && ss && sp->height == ss->height && sp->root == ss->root);
+  };
+  auto next = [&par] {
+    return QTC::Block(static_cast<uint32_t>(par.getBlockCount()), par.getTipHash(), 0);
+  };
+
+  QTC::Block fund = next();
+  for (const auto& s : senders) fund.addTransaction(QTC::Transaction("COINBASE", s, 1000, 0));
+  connect(fund);
+
+  QTC::Block wide = next();
+  wide.addTransaction(QTC::Transaction("COINBASE", miner, 50, 0));
+  // three layers: each sender's txs come a layer apart
+  for (size_t i = 0; i < k; ++i) wide.addTransaction(transfer(i, sinks[i], 10));
+  for (size_t i = 0; i < k; ++i) wide.addTransaction(transfer(i, senders[i], 5));
+  for (size_t i = 0; i < k; ++i) wide.addTransaction(transfer(i, sinks[(i + 1) % k], 2000));
+  CHECK(wide.getTransactions().size() >= 256);
+  connect(wide);
+  CHECK(par.getBalance(senders[0]) == 0);
+  CHECK(par.getBalance(sinks[1]) == 2010);
+
+  QTC::Block chained = next();
+  chained.addTransaction(QTC::Transaction("COINBASE", hot, 50, 0));
+  for (size_t n = 0; n < 3; ++n)
+    for (size_t i = 0; i < k; ++i) chained.addTransaction(transfer(i, hot, 1 + n));
+  connect(chained);
+  CHECK(par.getBalance(hot) == 50 + k * 6);
+
+  std::vector<uint64_t> a, b;
+  CHECK(par.getBalances(all, a) == ser.getBalances(all, b));
+  CHECK(a == b);
+}
+
+}
+
+int main() {
+  tampered_txid();
+  tampered_txid_in_block();
+  peer_block_difficulty();
+  peer_block_clears_mempool();
+  parallel_balances();
+  return QTC::test::check_result();
+}
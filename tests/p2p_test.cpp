@@ -0,0 +1,139 @@
+// tests/p2p_test.cpp
+// Relay and snapshot sync rules of the P2P layer, over loopback. Prints
+// each failed check and exits non-zero if there was one.
+#include "blockchain/Block.h"
+#include "blockchain/Blockchain.h"
+#include "blockchain/Snapshot.h"
+#include "blockchain/Transaction.h"
+#include "crypto/Signature.h"
+#include "network/Node.h"
+#include "Check.h"
+#include <boost/asio.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using pt = boost::property_tree::ptree;
+using Clock = std::chrono::steady_clock;
+
+std::string to_json(const pt& j) {
+  std::ostringstream o;
+  boost::property_tree::write_json(o, j, false);
+  return o.str();
+}
+
+bool wait_for(const std::function<bool()>& cond) {
+  auto deadline = Clock::now() + std::chrono::seconds(5);
+  while (!cond()) {
+    if (Clock::now() >= deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  return true;
+}
+
+// A forged copy that carries the real txid or block hash arrives first; the
+// genuine one after it must still be taken (and not dropped as seen).
+void forged_copy_first() {
+  QTC::Blockchain source(0), chain(0);
+  QTC::P2P node(&chain);
+  chain.setP2P(&node);
+  node.listen(0);
+
+  net::io_context ioc;
+  tcp::socket peer(ioc);
+  peer.connect(tcp::endpoint(net::ip::make_address("127.0.0.1"), node.port()));
+  auto send = [&peer](QTC::P2P::Msg type, const pt& j) {
+    net::write(peer, net::buffer(QTC::P2P::pack(type, to_json(j))));
+  };
+
+  auto key = QTC::Signature::generate();
+  std::string from = QTC::Signature::address(key.pub);
+  source.minePendingTransactions(from);
+  send(QTC::P2P::Msg::Block, source.getLatestBlock()->toPtree());
+  CHECK(wait_for([&chain] { return chain.getBlockCount() == 2; }));
+
+  QTC::Transaction tx(from, QTC::Signature::address(QTC::Signature::generate().pub), 5, 1);
+  tx.sign(key.priv, key.pub);
+  pt good = tx.toPtree();
+  pt amount = good, unsigned_ = good;
+  amount.put("amount", 500);
+  unsigned_.erase("sig");
+  unsigned_.erase("pubkey");
+  send(QTC::P2P::Msg::Tx, amount);
+  send(QTC::P2P::Msg::Tx, unsigned_);
+  send(QTC::P2P::Msg::Tx, good);
+  CHECK(wait_for([&chain, &tx] { return chain.getPendingById(tx.getId()).has_value(); }));
+  auto pending = chain.getPendingById(tx.getId());
+  CHECK(pending && pending->getAmount() == 5);
+
+  // signatures are outside the block hash: stripping one keeps the hash
+  CHECK(source.addTransaction(tx));
+  source.minePendingTransactions(from);
+  pt block = source.getLatestBlock()->toPtree();
+  pt stripped = block;
+  for (auto& t : stripped.get_child("tx")) {
+    t.second.erase("sig");
+    t.second.erase("pubkey");
+  }
+  CHECK(QTC::Block::fromPtree(stripped)->hasValidHash());
+  send(QTC::P2P::Msg::Block, stripped);
+  send(QTC::P2P::Msg::Block, block);
+  CHECK(wait_for([&chain] { return chain.getBlockCount() == 3; }));
+  CHECK(chain.getTipHash() == source.getTipHash());
+
+  boost::system::error_code ec;
+  peer.close(ec);
+  node.stop();
+}
+
+
+// A snapshot is installed only when peers at two addresses offer it; two
+// connections from one address fall back to block sync.
+void snapshot_quorum_by_address() {
+  QTC::Blockchain a(0), b(0);
+  a.setSnapshotInterval(3);
+  b.setSnapshotInterval(3);
+  std::string miner = QTC::Signature::address(QTC::Signature::generate().pub);
+  for (int i = 0; i < 4; ++i) {
+    a.minePendingTransactions(miner);
+    CHECK(b.addBlockFromPeer(*a.getLatestBlock()));
+  }
+  CHECK(a.latestSnapshot() && b.latestSnapshot() && a.latestSnapshot()->root == b.latestSnapshot()->root);
+  QTC::P2P pa(&a), pb(&b);
+  pa.listen(0);
+  pb.listen(0);
+
+  auto join = [&](const std::string& hostA, const std::string& hostB) {
+    QTC::Blockchain fresh(0);
+    QTC::P2P node(&fresh);
+    fresh.setP2P(&node);
+    node.setSyncTimeout(std::chrono::milliseconds(300));
+    node.listen(0);
+    node.connect(hostA, pa.port());
+    node.connect(hostB, pb.port());
+    CHECK(wait_for([&fresh, &a] { return fresh.getTipHash() == a.getTipHash(); }));
+    uint64_t base = fresh.getBaseHeight();
+    node.stop();
+    return base;
+  };
+  CHECK(join("127.0.0.1", "127.0.0.1") == 0);
+  CHECK(join("127.0.0.2", "127.0.0.3") == a.latestSnapshot()->height - 1);
+
+  pa.stop();
+  pb.stop();
+}
+
+}
+
+int main() {
+  forged_copy_first();
+  snapshot_quorum_by_address();
+  return QTC::test::check_result();
+}
@@ -0,0 +1,160 @@
+// tests/rpc_test.cpp
+// RPC server behaviour against loopback clients. Prints each failed check
+// and exits non-zero if there was one.
+#include "rpc/RpcServer.h"
+#include "Check.h"
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+unsigned short free_port() {
+  net::io_context ioc;
+  tcp::acceptor a(ioc, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0));
+  return a.local_endpoint().port();
+}
+
+std::string post(const std::string& method, const std::string& params) {
+  std::string body = "{\"jsonrpc\":\"2.0\",\"id\":\"1\",\"method\":\"" + method + "\",\"params\":" + params + "}";
+  return "POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\nContent-Length: " +
+         std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Subscribers that leave while lines are being pushed to them: each sink
+// turns Closed, and the queued lines (one of them being written) are
+// released without the write touching them afterwards.
+void subscribe_disconnect() {
+  const size_t kClients = 20;
+  QTC::RpcServer rpc;
+  std::mutex mu;
+  std::vector<std::shared_ptr<QTC::RpcServer::Sink>> sinks;
+  rpc.addSubscribe("subscribe", [&](const QTC::RpcServer::PTree&, const std::shared_ptr<QTC::RpcServer::Sink>& s) {
+    std::lock_guard<std::mutex> lk(mu);
+    sinks.push_back(s);
+    return true;
+  }, 64);
+  unsigned short port = free_port();
+  rpc.start("127.0.0.1", port, 2);
+
+  std::atomic<bool> done{false};
+  std::thread pusher([&] {
+    // larger than a socket buffer, so a write is still pending when the
+    // client goes
+    std::string line(1 << 20, 'x');
+    line += '\n';
+    while (!done) {
+      std::vector<std::shared_ptr<QTC::RpcServer::Sink>> now;
+      {
+        std::lock_guard<std::mutex> lk(mu);
+        now = sinks;
+      }
+      for (auto& s : now) s->push(line);
+      std::this_thread::yield();
+    }
+  });
+
+  tcp::endpoint ep(net::ip::make_address("127.0.0.1"), port);
+  for (size_t i = 0; i < kClients; ++i) {
+    net::io_context ioc;
+    tcp::socket c(ioc);
+    boost::system::error_code ec;
+    c.connect(ep, ec);
+    CHECK(!ec);
+    if (ec) break;
+    net::write(c, net::buffer(post("subscribe", "[]")), ec);
+    // read part of the stream and stop reading, so the server's writes back
+    // up; hang up the sending side first (the server sees EOF with a write
+    // pending), then drop the connection
+    char buf[8192];
+    size_t got = 0;
+    while (!ec && got < 64 * 1024) got += c.read_some(net::buffer(buf), ec);
+    CHECK(got >= 64 * 1024);
+    c.shutdown(tcp::socket::shutdown_send, ec);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    c.close(ec);
+  }
+
+  auto deadline = Clock::now() + std::chrono::seconds(10);
+  bool all = false;
+  while (!all && Clock::now() < deadline) {
+    all = true;
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      for (auto& s : sinks) all = all && s->closed();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  done = true;
+  pusher.join();
+  CHECK(sinks.size() == kClients);
+  CHECK(all);
+  rpc.stop();
+}
+
+// Reads a whole HTTP response (the server closes after each one).
+std::string fetch(unsigned short port, const std::string& request) {
+  net::io_context ioc;
+  tcp::socket c(ioc);
+  boost::system::error_code ec;
+  c.connect(tcp::endpoint(net::ip::make_address("127.0.0.1"), port), ec);
+  if (ec) return "";
+  net::write(c, net::buffer(request), ec);
+  std::string out;
+  char buf[4096];
+  while (!ec) out.append(buf, c.read_some(net::buffer(buf), ec));
+  return out;
+}
+
+// A client that asks for a long stream and never reads it: the stream
+// gives up after the write timeout, and the single Heavy worker serves the
+// next call.
+void stalled_stream_reader() {
+  QTC::RpcServer rpc;
+  rpc.setWriteTimeout(std::chrono::milliseconds(200));
+  std::atomic<bool> ended{false};
+  rpc.addStream("flood", [&ended](const QTC::RpcServer::PTree&, const QTC::RpcServer::Emit& emit) {
+    QTC::RpcServer::PTree item;
+    item.put("pad", std::string(64 * 1024, 'x'));
+    while (emit(item)) {}
+    ended = true;
+  });
+  rpc.add("ping", [](const QTC::RpcServer::PTree&) {
+    QTC::RpcServer::PTree r;
+    r.put("", "pong");
+    return r;
+  }, QTC::RpcServer::Cost::Heavy);
+  unsigned short port = free_port();
+  rpc.start("127.0.0.1", port, 2);
+
+  net::io_context ioc;
+  tcp::socket c(ioc);
+  boost::system::error_code ec;
+  c.connect(tcp::endpoint(net::ip::make_address("127.0.0.1"), port), ec);
+  net::write(c, net::buffer(post("flood", "[]")), ec);
+  CHECK(!ec);
+
+  auto deadline = Clock::now() + std::chrono::seconds(5);
+  while (!ended && Clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  CHECK(ended);
+  CHECK(fetch(port, post("ping", "[]")).find("pong") != std::string::npos);
+  c.close(ec);
+  rpc.stop();
+}
+
+}
+
+int main() {
+  subscribe_disconnect();
+  stalled_stream_reader();
+  return QTC::test::check_result();
+}
@@ -0,0 +1,165 @@
+// tests/vm_test.cpp
+// Contract bytecode: what Program::verify refuses, gas accounting, and
+// contract storage left untouched by a call that runs out of gas. Built
+// twice, against the threaded and the switch interpreter, with the same
+// expected results. Prints each failed check and exits non-zero if there
+// was one.
+#include "blockchain/Blockchain.h"
+#include "vm/VM.h"
+#include "Check.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+using QTC::Instr;
+using QTC::Op;
+using QTC::Program;
+using QTC::VM;
+
+Instr ins(Op op, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, int32_t imm = 0) {
+  return Instr{static_cast<uint8_t>(op), a, b, c, imm};
+}
+
+class MapStorage : public QTC::Storage {
+public:
+  uint64_t load(uint64_t key) override { return words[key]; }
+  void store(uint64_t key, uint64_t value) override { words[key] = value; }
+  std::map<uint64_t, uint64_t> words;
+};
+
+// the reason Program::verify gives for code, "" if it is accepted
+std::string rejection(const std::vector<Instr>& code) {
+  std::string err;
+  return Program::verify(code, &err) ? "" : err;
+}
+
+void verify_rejects() {
+  CHECK(rejection({}) == "empty program");
+  CHECK(rejection(std::vector<Instr>(VM::kMaxCode + 1, ins(Op::Halt))) == "program too large");
+  CHECK(rejection({ins(Op::Count), ins(Op::Halt)}) == "unknown opcode at 0");
+  CHECK(rejection({Instr{0xff, 0, 0, 0, 0}}) == "unknown opcode at 0");
+  CHECK(rejection({ins(Op::Add, 0, 1, VM::kRegs), ins(Op::Halt)}) == "bad register at 0");
+  CHECK(rejection({ins(Op::Halt), ins(Op::Mov, VM::kRegs, 0)}) == "bad register at 1");
+  CHECK(rejection({ins(Op::Jmp, 0, 0, 0, 1)}) == "jump out of range at 0");
+  CHECK(rejection({ins(Op::Jz, 0, 0, 0, -1), ins(Op::Halt)}) == "jump out of range at 0");
+  CHECK(rejection({ins(Op::LoadI, 0, 0, 0, 1)}) == "program can fall off the end");
+  CHECK(rejection({ins(Op::Jnz, 0, 0, 0, 0)}) == "program can fall off the end");
+  CHECK(rejection({ins(Op::Jmp, 0, 0, 0, 0)}) == "");
+  CHECK(rejection({ins(Op::LoadI, 0, 0, 0, 1), ins(Op::Ret, 0)}) == "");
+}
+
+// r0 = n; returns 1 + 2 + ... + n, four gas per round and two to leave
+std::vector<Instr> sum_to_n() {
+  return {
+    ins(Op::Jz, 0, 0, 0, 4),
+    ins(Op::Add, 1, 1, 0),
+    ins(Op::AddI, 0, 0, 0, -1),
+    ins(Op::Jmp, 0, 0, 0, 0),
+    ins(Op::Ret, 1),
+  };
+}
+
+void gas_accounting() {
+  auto p = Program::verify(sum_to_n());
+  CHECK(p);
+  if (!p) return;
+  MapStorage st;
+  uint64_t n = 10;
+
+  auto r = VM::run(*p, st, 42, &n, 1);
+  CHECK(r.status == VM::Status::Ok && r.value == 55 && r.gasUsed == 42);
+
+  // one short: out of gas uses the whole limit and yields no value
+  r = VM::run(*p, st, 41, &n, 1);
+  CHECK(r.status == VM::Status::OutOfGas && r.value == 0 && r.gasUsed == 41);
+
+  r = VM::run(*p, st, 0, &n, 1);
+  CHECK(r.status == VM::Status::OutOfGas && r.gasUsed == 0);
+
+  // limits past INT64_MAX are clamped, not wrapped negative
+  r = VM::run(*p, st, UINT64_MAX, &n, 1);
+  CHECK(r.status == VM::Status::Ok && r.value == 55 && r.gasUsed == 42);
+
+  auto spin = Program::verify({ins(Op::Jmp, 0, 0, 0, 0)});
+  r = VM::run(*spin, st, 1000);
+  CHECK(r.status == VM::Status::OutOfGas && r.gasUsed == 1000);
+
+  // arithmetic edge cases the handlers define rather than trap on
+  auto ops = Program::verify({
+    ins(Op::Div, 2, 0, 1), ins(Op::Mod, 3, 0, 1), ins(Op::Add, 2, 2, 3),
+    ins(Op::LoadI, 4, 0, 0, -1), ins(Op::LoadHi, 4, 0, 0, 7), ins(Op::Shr, 4, 4, 0),
+    ins(Op::Add, 2, 2, 4), ins(Op::Ret, 2),
+  });
+  uint64_t args[] = {32, 0};
+  r = VM::run(*ops, st, 100, args, 2);
+  CHECK(r.status == VM::Status::Ok && r.value == 0x7ffffffffULL >> 32);
+  CHECK(r.gasUsed == 4 + 4 + 1 + 1 + 1 + 1 + 1 + 1);
+}
+
+// r0 = key, r1 = value, r2 = spin: stores, reads the word back, and when
+// spin is set loops until the gas runs out
+std::vector<Instr> store_then_maybe_spin() {
+  return {
+    ins(Op::SStore, 0, 1),
+    ins(Op::SLoad, 3, 0),
+    ins(Op::Jnz, 2, 0, 0, 2),
+    ins(Op::Ret, 3),
+  };
+}
+
+void storage_rollback() {
+  // the interpreter itself writes through; keeping them is the caller's call
+  MapStorage st;
+  auto p = Program::verify(store_then_maybe_spin());
+  uint64_t spin[] = {5, 99, 1};
+  auto r = VM::run(*p, st, 10000, spin, 3);
+  CHECK(r.status == VM::Status::OutOfGas && st.words[5] == 99);
+
+  QTC::Blockchain chain(0);
+  std::string err;
+  std::string addr = chain.deployContract(store_then_maybe_spin(), &err);
+  CHECK(!addr.empty());
+  CHECK(chain.deployContract({ins(Op::Halt), ins(Op::Add)}, &err).empty() && err == "program can fall off the end");
+
+  VM::Result out{};
+  CHECK(chain.callContract(addr, {5, 42, 0}, 10000, out));
+  CHECK(out.status == VM::Status::Ok && out.value == 42 && out.gasUsed == 200 + 50 + 1 + 1);
+  CHECK(chain.getStorage(addr, 5) == 42);
+
+  // the store is seen by the SLoad in the same call, then dropped
+  CHECK(chain.callContract(addr, {5, 99, 1}, 10000, out));
+  CHECK(out.status == VM::Status::OutOfGas && out.gasUsed == 10000);
+  CHECK(chain.getStorage(addr, 5) == 42);
+  CHECK(chain.callContract(addr, {6, 7, 1}, 10000, out));
+  CHECK(chain.getStorage(addr, 6) == 0);
+
+  // storing 0 clears the word
+  CHECK(chain.callContract(addr, {5, 0, 0}, 10000, out));
+  CHECK(out.status == VM::Status::Ok && chain.getStorage(addr, 5) == 0);
+
+  CHECK(!chain.callContract("QTCnosuchcontract", {}, 10000, out));
+}
+
+void encoding() {
+  auto code = store_then_maybe_spin();
+  code.push_back(ins(Op::LoadI, 1, 2, 3, -123456));
+  std::vector<Instr> back;
+  CHECK(Program::decode(Program::encode(code), back) && back.size() == code.size());
+  for (size_t i = 0; i < code.size() && i < back.size(); ++i) {
+    CHECK(back[i].op == code[i].op && back[i].a == code[i].a && back[i].b == code[i].b &&
+          back[i].c == code[i].c && back[i].imm == code[i].imm);
+  }
+  CHECK(!Program::decode(std::string(7, '\0'), back));
+}
+
+}
+
+int main() {
+  verify_rejects();
+  gas_accounting();
+  storage_rollback();
+  encoding();
+  return QTC::test::check_result();
+}
@@ -0,0 +1,176 @@
+// tests/wallet_test.cpp
+// Wallet key file and balances: keys survive a reopen, a file others can
+// read gets no new keys, a pair that does not sign for itself fails the
+// load, and balances followed block by block (or reloaded after a gap)
+// match the chain's. Prints each failed check and exits non-zero if there
+// was one.
+#include "blockchain/Blockchain.h"
+#include "blockchain/Snapshot.h"
+#include "blockchain/Transaction.h"
+#include "crypto/Signature.h"
+#include "wallet/Wallet.h"
+#include "Check.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// a fresh directory, removed with everything in it when this goes away
+struct TempDir {
+  std::string path;
+  TempDir() {
+    std::string tmpl = (fs::temp_directory_path() / "qtc_wallet_XXXXXX").string();
+    if (::mkdtemp(&tmpl[0])) path = tmpl;
+  }
+  ~TempDir() {
+    std::error_code ec;
+    if (!path.empty()) fs::remove_all(path, ec);
+  }
+};
+
+void write_keys(const std::string& dir, const std::string& contents) {
+  std::ofstream(dir + "/keys") << contents;
+  ::chmod((dir + "/keys").c_str(), 0600);
+}
+
+void key_file() {
+  TempDir d;
+  CHECK(!d.path.empty());
+  std::vector<std::string> made;
+  {
+    QTC::Wallet w;
+    CHECK(w.open(d.path));
+    CHECK(w.addresses().empty());
+    for (int i = 0; i < 3; ++i) made.push_back(w.create());
+  }
+  struct stat st;
+  CHECK(::stat((d.path + "/keys").c_str(), &st) == 0 && (st.st_mode & 0777) == 0600);
+
+  QTC::Wallet w;
+  CHECK(w.open(d.path));
+  CHECK(w.addresses() == made);
+  QTC::Transaction tx(made[1], made[2], 1, 0);
+  CHECK(w.sign(tx) && tx.verifySignature());
+  QTC::Transaction stranger(QTC::Signature::address(QTC::Signature::generate().pub), made[0], 1, 0);
+  CHECK(!w.sign(stranger));
+
+  // readable by others: existing keys still load, new ones are not written
+  ::chmod((d.path + "/keys").c_str(), 0644);
+  CHECK(w.create().empty());
+  CHECK(w.addresses() == made);
+  QTC::Wallet loose;
+  CHECK(loose.open(d.path) && loose.addresses() == made);
+}
+
+void bad_key_file() {
+  auto a = QTC::Signature::generate(), b = QTC::Signature::generate();
+  TempDir d;
+
+  // well-formed hex, but a's private key does not sign for b's public key
+  write_keys(d.path, a.priv + " " + a.pub + "\n" + a.priv + " " + b.pub + "\n");
+  QTC::Wallet mismatched;
+  CHECK(!mismatched.open(d.path));
+
+  write_keys(d.path, a.priv + "\n");
+  QTC::Wallet truncated;
+  CHECK(!truncated.open(d.path));
+
+  write_keys(d.path, a.priv + " " + a.pub.substr(1) + "g\n");
+  QTC::Wallet nonhex;
+  CHECK(!nonhex.open(d.path));
+
+  // blank lines and a key listed twice are fine
+  write_keys(d.path, "\n" + a.priv + " " + a.pub + "\n\n" + a.priv + " " + a.pub + "\n");
+  QTC::Wallet ok;
+  CHECK(ok.open(d.path) && ok.addresses().size() == 1);
+}
+
+// what the wallet says for its addresses against what the chain says
+void check_balances(const QTC::Wallet& w, const QTC::Blockchain& chain) {
+  auto addrs = w.addresses();
+  std::vector<uint64_t> want;
+  chain.getBalances(addrs, want);
+  uint64_t total = 0;
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    CHECK(w.balance(addrs[i]) == want[i]);
+    total += want[i];
+  }
+  CHECK(w.balance() == total);
+}
+
+void follows_chain() {
+  TempDir d;
+  QTC::Blockchain chain(0);
+  chain.setSnapshotInterval(3);
+  QTC::Wallet w;
+  CHECK(w.open(d.path));
+  w.attach(chain);
+  std::string a = w.create(), b = w.create();
+  std::string other = QTC::Signature::address(QTC::Signature::generate().pub);
+
+  chain.minePendingTransactions(a);
+  check_balances(w, chain);
+  uint64_t reward = w.balance(a);
+  CHECK(reward > 20);
+
+  // a pending spend holds back what it uses until it is mined
+  std::string from = w.spendable(reward - 5);
+  CHECK(from == a);
+  QTC::Transaction tx(from, b, reward - 10, 1);
+  CHECK(w.sign(tx) && chain.addTransaction(tx));
+  CHECK(w.spendable(10).empty());
+  CHECK(w.spendable(9) == a);
+  chain.minePendingTransactions(other);
+  check_balances(w, chain);
+  CHECK(w.balance(b) == reward - 10 && w.balance(a) == 9);
+  CHECK(w.spendable(reward - 10) == b);
+
+  // an overdraft clamps to 0 on both sides
+  QTC::Transaction pay(b, a, 4, 1), over(b, other, reward - 12, 0);
+  CHECK(w.sign(pay) && chain.addTransaction(pay));
+  CHECK(w.sign(over) && chain.addTransaction(over));
+  chain.minePendingTransactions(a);
+  check_balances(w, chain);
+  CHECK(w.balance(b) == 0);
+
+  auto hist = w.transactions(10);
+  CHECK(hist.size() == 5 && hist.front().height == 3 && hist.back().from == "COINBASE");
+
+  // A node that installs the snapshot taken after block 2 never sees
+  // blocks 1-2; the first block it connects is past the gap, so its wallet
+  // reloads every balance rather than applying that block to nothing.
+  auto snap = chain.latestSnapshot();
+  CHECK(snap && snap->height == 3);
+  if (!snap) return;
+  std::map<std::string, uint64_t> bals;
+  for (const auto& c : snap->chunks) CHECK(QTC::Snapshot::parseChunk(c, bals));
+
+  QTC::Blockchain fresh(0);
+  QTC::Wallet w2;
+  CHECK(w2.open(d.path));
+  w2.attach(fresh);
+  CHECK(fresh.installSnapshot(*snap, bals));
+  QTC::Transaction back(a, b, 7, 0);
+  CHECK(w.sign(back) && chain.addTransaction(back));
+  chain.minePendingTransactions(other);
+  for (uint64_t k = 3; k < chain.getBlockCount(); ++k) CHECK(fresh.addBlockFromPeer(*chain.getBlockCopyByIndex(k)));
+  check_balances(w2, fresh);
+  check_balances(w, chain);
+  CHECK(w2.balance() == w.balance() && w2.balance(b) == 7);
+}
+
+}
+
+int main() {
+  key_file();
+  bad_key_file();
+  follows_chain();
+  return QTC::test::check_result();
+}